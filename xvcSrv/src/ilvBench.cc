@@ -0,0 +1,132 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+// Micro-benchmark for the TMS/TDI interleave kernels; every kernel
+// is checked against the scalar one and its throughput reported.
+
+#include <xvcIlv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+
+using std::vector;
+
+static void usage(const char *nm)
+{
+	fprintf(stderr, "Usage: %s [-h] [-s <bytes>] [-n <iterations>]\n", nm);
+	fprintf(stderr, "       -h            : this message\n");
+	fprintf(stderr, "       -s <bytes>    : vector size (default 1000003; odd so the tail is exercised)\n");
+	fprintf(stderr, "       -n <iter>     : iterations per kernel (default 200)\n");
+}
+
+static double
+now()
+{
+struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (double)ts.tv_sec + (double)ts.tv_nsec/1.0E9;
+}
+
+int
+main(int argc, char **argv)
+{
+int              opt;
+unsigned long    bytes = 1000003;
+unsigned         iter  = 200;
+unsigned long   *u_p;
+unsigned        *i_p;
+unsigned         wsz, i, k, nk, it;
+unsigned long    dlen;
+IlvKernel        kern[8];
+double           t, base;
+int              rval  = 0;
+
+	while ( (opt = getopt(argc, argv, "hs:n:")) > 0 ) {
+		u_p = 0;
+		i_p = 0;
+		switch ( opt ) {
+			case 'h': usage( argv[0] ); return 0;
+			case 's': u_p = &bytes; break;
+			case 'n': i_p = &iter;  break;
+			default:
+				fprintf(stderr, "Unknown option -%c\n", opt);
+				usage( argv[0] );
+				return 1;
+		}
+		if ( u_p && 1 != sscanf(optarg, "%li", u_p) ) {
+			fprintf(stderr, "Unable to scan argument to option -%c\n", opt);
+			return 1;
+		}
+		if ( i_p && 1 != sscanf(optarg, "%i", i_p) ) {
+			fprintf(stderr, "Unable to scan argument to option -%c\n", opt);
+			return 1;
+		}
+	}
+
+	if ( ! bytes || ! iter ) {
+		fprintf(stderr, "Size and iterations must be > 0\n");
+		return 1;
+	}
+
+	vector<uint8_t> tms( bytes );
+	vector<uint8_t> tdi( bytes );
+
+	srandom( 1 );
+	for ( i = 0; i < bytes; i++ ) {
+		tms[i] = random();
+		tdi[i] = random();
+	}
+
+	printf("%4s %-8s %10s %8s\n", "wsz", "kernel", "MB/s", "speedup");
+
+	for ( wsz = 4; wsz <= 16; wsz++ ) {
+		dlen = 2*((bytes + wsz - 1)/wsz)*wsz;
+
+		vector<uint8_t> ref( dlen, 0xaa );
+		vector<uint8_t> out( dlen, 0x55 );
+
+		nk = ilvKernels( wsz, kern, sizeof(kern)/sizeof(kern[0]) );
+
+		// kern[0] is the scalar reference
+		kern[0].func( &ref[0], &tms[0], &tdi[0], bytes, wsz );
+
+		base = 0.0;
+		for ( k = 0; k < nk; k++ ) {
+			kern[k].func( &out[0], &tms[0], &tdi[0], bytes, wsz );
+			if ( memcmp( &out[0], &ref[0], dlen ) ) {
+				printf("%4u %-8s MISMATCH\n", wsz, kern[k].name);
+				rval = 1;
+				continue;
+			}
+			t = now();
+			for ( it = 0; it < iter; it++ ) {
+				kern[k].func( &out[0], &tms[0], &tdi[0], bytes, wsz );
+			}
+			t = now() - t;
+			// count input + output octets
+			t = (double)iter * (double)(2*bytes + dlen) / t / 1.0E6;
+			if ( 0 == k ) {
+				base = t;
+			}
+			printf("%4u %-8s %10.0f %7.2fx\n", wsz, kern[k].name, t, t/base);
+		}
+	}
+
+	return rval;
+}
@@ -0,0 +1,171 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcBufPool.h>
+#include <xvcDriver.h>
+#include <sys/mman.h>
+
+static unsigned long
+hugePageSize()
+{
+FILE          *f;
+char           buf[256];
+unsigned long  kb = 0;
+
+	if ( (f = fopen("/proc/meminfo", "r")) ) {
+		while ( fgets( buf, sizeof(buf), f ) ) {
+			if ( 1 == sscanf( buf, "Hugepagesize: %lu kB", &kb ) ) {
+				break;
+			}
+		}
+		fclose( f );
+	}
+	return kb ? kb*1024 : 2*1024*1024;
+}
+
+XvcBufPool::XvcBufPool()
+: huge_  ( false                      ),
+  hugeSz_( 0                          ),
+  pageSz_( sysconf( _SC_PAGE_SIZE )   )
+{
+	pthread_mutex_init( &mtx_, 0 );
+}
+
+XvcBufPool::~XvcBufPool()
+{
+unsigned i;
+	for ( i = 0; i < free_.size(); i++ ) {
+		unmap( &free_[i] );
+	}
+	pthread_mutex_destroy( &mtx_ );
+}
+
+XvcBufPool *
+XvcBufPool::get()
+{
+static XvcBufPool thePool;
+	return &thePool;
+}
+
+void
+XvcBufPool::setHugePages(bool huge)
+{
+MtxLock        lck( &mtx_ );
+
+	huge_ = huge;
+	if ( huge_ && ! hugeSz_ ) {
+		hugeSz_ = hugePageSize();
+	}
+}
+
+void
+XvcBufPool::unmap(Block *b)
+{
+	munmap( b->mem_, b->siz_ );
+}
+
+uint8_t *
+XvcBufPool::lease(unsigned long *psiz)
+{
+MtxLock        lck( &mtx_ );
+unsigned       i, best;
+unsigned long  siz;
+void          *mem = MAP_FAILED;
+uint8_t       *rval;
+
+	// smallest idle block that fits
+	best = free_.size();
+	for ( i = 0; i < free_.size(); i++ ) {
+		if ( free_[i].siz_ >= *psiz && ( best == free_.size() || free_[i].siz_ < free_[best].siz_ ) ) {
+			best = i;
+		}
+	}
+
+	if ( best < free_.size() ) {
+		rval  = free_[best].mem_;
+		*psiz = free_[best].siz_;
+		free_.erase( free_.begin() + best );
+		return rval;
+	}
+
+	if ( huge_ ) {
+		siz = ((*psiz + hugeSz_ - 1)/hugeSz_) * hugeSz_;
+		mem = mmap( 0, siz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | MAP_HUGETLB, -1, 0 );
+		if ( MAP_FAILED == mem ) {
+			fprintf(stderr, "WARNING: unable to allocate huge pages (%s); using normal pages\n", strerror(errno));
+			huge_ = false;
+		}
+	}
+
+	if ( MAP_FAILED == mem ) {
+		siz = ((*psiz + pageSz_ - 1)/pageSz_) * pageSz_;
+		mem = mmap( 0, siz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0 );
+		if ( MAP_FAILED == mem ) {
+			throw SysErr("XvcBufPool: unable to map buffer memory");
+		}
+	}
+
+	*psiz = siz;
+	return (uint8_t*)mem;
+}
+
+void
+XvcBufPool::release(uint8_t *mem, unsigned long siz)
+{
+MtxLock        lck( &mtx_ );
+Block          b;
+unsigned       i, smallest;
+
+	b.mem_ = mem;
+	b.siz_ = siz;
+
+	if ( free_.size() >= MAX_FREE ) {
+		// drop the smallest block; big ones are the expensive ones
+		for ( smallest = i = 0; i < free_.size(); i++ ) {
+			if ( free_[i].siz_ < free_[smallest].siz_ ) {
+				smallest = i;
+			}
+		}
+		if ( free_[smallest].siz_ >= siz ) {
+			unmap( &b );
+			return;
+		}
+		unmap( &free_[smallest] );
+		free_.erase( free_.begin() + smallest );
+	}
+	free_.push_back( b );
+}
+
+void
+XvcBuf::resize(unsigned long siz)
+{
+	if ( siz <= siz_ ) {
+		return;
+	}
+	release();
+	mem_ = XvcBufPool::get()->lease( &siz );
+	siz_ = siz;
+}
+
+void
+XvcBuf::release()
+{
+	if ( mem_ ) {
+		XvcBufPool::get()->release( mem_, siz_ );
+		mem_ = 0;
+		siz_ = 0;
+	}
+}
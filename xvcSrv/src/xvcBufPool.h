@@ -0,0 +1,114 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_BUF_POOL_H
+#define XVC_BUF_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+using std::vector;
+
+// Process-wide pool of raw (uninitialized) buffer memory.
+//
+// Blocks are mmap()ed, prefaulted (MAP_POPULATE) and optionally
+// backed by huge pages. Released blocks are kept and handed out
+// again to the next lease of a fitting size, so that a reconnecting
+// client neither faults in nor clears its buffers again.
+class XvcBufPool {
+private:
+	typedef struct {
+		uint8_t       *mem_;
+		unsigned long  siz_;
+	} Block;
+
+	vector<Block>      free_;
+	pthread_mutex_t    mtx_;
+	bool               huge_;
+	unsigned long      hugeSz_;
+	unsigned long      pageSz_;
+
+	// max. number of idle blocks we hold on to
+	static const unsigned MAX_FREE = 8;
+
+	XvcBufPool();
+	~XvcBufPool();
+
+	XvcBufPool(const XvcBufPool&);
+	XvcBufPool & operator=(const XvcBufPool&);
+
+	void           unmap(Block *b);
+
+public:
+	// lease a block of at least '*psiz' octets; the actual size
+	// is returned in '*psiz'. The memory is NOT zeroed.
+	uint8_t       *lease(unsigned long *psiz);
+
+	// return a block to the pool
+	void           release(uint8_t *mem, unsigned long siz);
+
+	// back new blocks by huge pages (falls back to normal
+	// pages if none are available)
+	void           setHugePages(bool huge);
+
+	static XvcBufPool *get();
+};
+
+// A buffer leased from the pool (RAII). Use like a raw array;
+// 'resize' does NOT preserve the contents.
+class XvcBuf {
+private:
+	uint8_t           *mem_;
+	unsigned long      siz_;
+
+	XvcBuf(const XvcBuf&);
+	XvcBuf & operator=(const XvcBuf&);
+
+public:
+	XvcBuf()
+	: mem_( 0 ),
+	  siz_( 0 )
+	{
+	}
+
+	// make sure the buffer holds at least 'siz' octets
+	void resize(unsigned long siz);
+
+	void release();
+
+	unsigned long size() const
+	{
+		return siz_;
+	}
+
+	uint8_t & operator[](unsigned long i)
+	{
+		return mem_[i];
+	}
+
+	const uint8_t & operator[](unsigned long i) const
+	{
+		return mem_[i];
+	}
+
+	~XvcBuf()
+	{
+		release();
+	}
+};
+
+#endif
@@ -15,61 +15,189 @@
 //-----------------------------------------------------------------------------
 
 #include <xvcConn.h>
+#include <xvcConnUring.h>
 
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <time.h>
 
-XvcConn::XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen )
+XvcConn::XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen, unsigned flags )
 : drv_       ( drv         ),
   ld_        ( sd          ),
+  epfd_      ( -1          ),
+  rcvLoWat_  ( 1           ),
+  maxLoWat_  ( 1           ),
+  rxWant_    ( 1           ),
+  nReads_    ( 0           ),
+  nWaits_    ( 0           ),
+  nShifts_   ( 0           ),
+  nBits_     ( 0           ),
   maxVecLen_ ( maxVecLen   ),
-  supVecLen_ ( 0           )
+  supVecLen_ ( 0           ),
+  flags_     ( flags       ),
+  spinUs_    ( SPIN_US     ),
+  prfVecLen_ ( 0           ),
+  rxOff_     ( 0           )
 {
-socklen_t sz = sizeof(peer_);
+socklen_t          sz;
+struct epoll_event ev;
+int                rcvbuf;
+
+	if ( (epfd_ = epoll_create1( EPOLL_CLOEXEC )) < 0 ) {
+		throw SysErr("Unable to create epoll instance");
+	}
+
+	// the listening socket is non-blocking; edge-triggered is
+	// sufficient since 'reject' always drains it.
+	ev.events  = EPOLLIN | EPOLLET;
+	ev.data.fd = ld_;
+	if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, ld_, &ev ) ) {
+		::close( epfd_ );
+		throw SysErr("Unable to add listening socket to epoll set");
+	}
 
 	// RAII for the sd_
-	if ( (sd_ = ::accept(ld_, (struct sockaddr*)&peer_, &sz) ) < 0 ) {
-		throw SysErr("Unable to accept connection");
+	while ( sz = sizeof(peer_), (sd_ = ::accept(ld_, (struct sockaddr*)&peer_, &sz) ) < 0 ) {
+		if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno ) {
+			::close( epfd_ );
+			throw SysErr("Unable to accept connection");
+		}
+		if ( epoll_wait( epfd_, &ev, 1, -1 ) < 0 && EINTR != errno ) {
+			::close( epfd_ );
+			throw SysErr("epoll_wait failed");
+		}
+	}
+
+	ev.events  = EPOLLIN;
+	ev.data.fd = sd_;
+	if ( epoll_ctl( epfd_, EPOLL_CTL_ADD, sd_, &ev ) ) {
+		::close( sd_   );
+		::close( epfd_ );
+		throw SysErr("Unable to add client socket to epoll set");
 	}
+
+	// the kernel clips SO_RCVLOWAT to half the receive buffer
+	sz = sizeof(rcvbuf);
+	if ( 0 == getsockopt( sd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &sz ) && rcvbuf > 2 ) {
+		maxLoWat_ = rcvbuf/2;
+	}
+
+	// updated by allocBufs()
+	drv_->getCaps( &drvCaps_ );
+}
+
+XvcConn *
+XvcConn::create( int sd, JtagDriver *drv, unsigned long maxVecLen, unsigned flags )
+{
+#ifdef HAVE_LIBURING
+	if ( (flags & IO_URING) ) {
+		return new XvcConnUring( sd, drv, maxVecLen, flags );
+	}
+#endif
+	return new XvcConn( sd, drv, maxVecLen, flags );
 }
 
 XvcConn::~XvcConn()
 {
-	::close( sd_ );
+	if ( drv_->getDebug() > 0 ) {
+		fprintf(stderr, "Connection closed: %lu reads, %lu waits\n", nReads_, nWaits_);
+	}
+	::close( sd_   );
+	::close( epfd_ );
 }
 
-ssize_t
-XvcConn::read(void *buf, size_t l)
+void
+XvcConn::setRcvLoWat(unsigned long n)
 {
-fd_set fds;
-int    nfds = (sd_ > ld_ ? sd_ : ld_) + 1;
-int    got;
+int val;
 
-	do {
-		FD_ZERO( &fds );
-		FD_SET(  sd_, &fds );
-		FD_SET(  ld_, &fds );
+	if ( n > maxLoWat_ ) {
+		n = maxLoWat_;
+	}
+	if ( n < 1 ) {
+		n = 1;
+	}
+	if ( n != rcvLoWat_ ) {
+		val = n;
+		if ( setsockopt( sd_, SOL_SOCKET, SO_RCVLOWAT, &val, sizeof(val) ) ) {
+			throw SysErr("Unable to set SO_RCVLOWAT");
+		}
+		rcvLoWat_ = n;
+	}
+}
 
+void
+XvcConn::reject()
+{
+struct sockaddr_in peer;
+socklen_t          asiz;
+int                newsd;
+
+	while ( asiz = sizeof(peer), (newsd = ::accept( ld_ , (struct sockaddr*)&peer, &asiz )) >= 0 ) {
+		::close( newsd );
+		fprintf(stderr, "WARNING: a new client (%s:%hu) tried to connect; I just closed this connection\n", inet_ntoa( peer.sin_addr ), ntohs( peer.sin_port ) );
+		fprintf(stderr, "         XVC supports only a single client!\n");
+	}
+}
+
+void
+XvcConn::wait()
+{
+struct epoll_event evs[2];
+int                got, i;
+bool               rdy = false;
 
-		if ( (got = select( nfds, &fds, 0, 0, 0 )) < 0 ) {
-			throw SysErr("select failed");
+	// don't wake up before what we need has arrived
+	setRcvLoWat( rxWant_ );
+
+	do {
+		nWaits_++;
+		if ( (got = epoll_wait( epfd_, evs, sizeof(evs)/sizeof(evs[0]), -1 )) < 0 ) {
+			if ( EINTR == errno ) {
+				continue;
+			}
+			throw SysErr("epoll_wait failed");
+		}
+		for ( i = 0; i < got; i++ ) {
+			if ( evs[i].data.fd == ld_ ) {
+				reject();
+			} else {
+				rdy = true;
+			}
 		}
+	} while ( ! rdy );
+}
 
-		if ( FD_ISSET(ld_, &fds) ) {
-			struct sockaddr_in peer;
-			socklen_t          asiz  = sizeof(peer);
-			int                newsd = ::accept( ld_ , (struct sockaddr*)&peer, &asiz );
-printf("Activity on LSD\n");
-			if ( newsd >= 0 ) {
-				::close( newsd );
-				fprintf(stderr, "WARNING: a new client (%s:%hu) tried to connect; I just closed this connection\n", inet_ntoa( peer.sin_addr ), ntohs( peer.sin_port ) );
-				fprintf(stderr, "         XVC supports only a single client!\n");
+ssize_t
+XvcConn::read(void *buf, size_t l)
+{
+ssize_t         got;
+bool            spin = false;
+struct timespec then, now;
+
+	// optimistically try to read first; only wait if there is nothing
+	while ( nReads_++, (got = ::recv( sd_, buf, l, MSG_DONTWAIT )) < 0 ) {
+		if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno ) {
+			break;
+		}
+		// the rest of a request is on its way; if the driver burns
+		// a CPU polling the target then we may as well poll, too
+		// (but not longer than the driver would).
+		if ( JtagDriver::WAIT_POLL == drvCaps_.waitMode_ && rxWant_ > 1 ) {
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			if ( ! spin ) {
+				then = now;
+				spin = true;
+			}
+			if ( (now.tv_sec - then.tv_sec)*1000000 + (now.tv_nsec - then.tv_nsec)/1000 < spinUs_ ) {
+				continue;
 			}
 		}
-	
-	} while ( ! FD_ISSET(sd_, &fds) );
+		wait();
+		spin = false;
+	}
 
-	return ::read(sd_, buf, l);
+	return got;
 }
 
 // fill rx buffer to 'n' octets
@@ -85,8 +213,12 @@ unsigned long k = n;
 
 	k -= rl_;
 	while ( k > 0 ) {
-		got = read( p, k );
-		if ( got <= 0 ) {
+		rxWant_ = k;
+		got     = read( p, k );
+		if ( 0 == got ) {
+			throw std::runtime_error("Client closed the connection in the middle of a request");
+		}
+		if ( got < 0 ) {
 			throw SysErr("Unable to read from socket");
 		}
 		k -= got;
@@ -102,7 +234,7 @@ XvcConn::bump(unsigned long n)
 	rp_ += n;
 	rl_ -= n;
 	if ( rl_ == 0 ) {
-		rp_ = &rxb_[0];
+		rp_ = &rxb_[rxOff_];
 	}
 }
 
@@ -130,32 +262,79 @@ unsigned long      overhead = 128; //headers and such;
 		supVecLen_ = tgtVecLen;
 	}
 
+	drv_->getCaps( &drvCaps_ );
+	if ( drvCaps_.align_ < 1 ) {
+		drvCaps_.align_ = 1;
+	}
+	spinUs_ = drvCaps_.spinUs_ ? drvCaps_.spinUs_ : SPIN_US;
+
+	// A driver which splits vectors itself may prefer longer ones
+	// (e.g., so that its pipeline doesn't drain between chunks) but
+	// in the streaming modes we want chunks for overlapping.
+	prfVecLen_ = supVecLen_;
+	if ( drvCaps_.chunk_ && ( drvCaps_.chunk_ < prfVecLen_ || ! (flags_ & (STREAM_SHIFT | CUT_THROUGH)) ) ) {
+		prfVecLen_ = drvCaps_.chunk_ < maxVecLen_ ? drvCaps_.chunk_ : maxVecLen_;
+	}
+	// chunks (but the last) should hold whole words
+	if ( prfVecLen_ > drvCaps_.align_ ) {
+		prfVecLen_ -= prfVecLen_ % drvCaps_.align_;
+	}
+
+	// a zero-copy driver hands the TMS/TDI words to the transport
+	// straight from rxb_; let the TMS vector of a request (following
+	// "shift:" and the length) start word-aligned.
+	rxOff_ = 0;
+	if ( drvCaps_.zeroCopy_ ) {
+		rxOff_ = (drvCaps_.align_ - SHIFT_HDR_LEN % drvCaps_.align_) % drvCaps_.align_;
+	}
+
+	if ( drv_->getDebug() > 0 ) {
+		fprintf(stderr, "Driver: alignment %u, max. in flight %u, zero-copy %s, %s wait; chunks of %lu bytes\n",
+			drvCaps_.align_,
+			drvCaps_.maxInFlight_,
+			drvCaps_.zeroCopy_ ? "yes" : "no",
+			JtagDriver::WAIT_POLL == drvCaps_.waitMode_ ? "polling" : "blocking",
+			prfVecLen_);
+	}
+
 	chunk_  = (2*maxVecLen_ + overhead);
 
-	rxb_.resize( 2*chunk_              );
-	txb_.resize( maxVecLen_ + overhead );
+	rxb_.resize( 2*chunk_ + rxOff_     );
+	if ( (flags_ & CUT_THROUGH) && prfVecLen_ < maxVecLen_ ) {
+		// only one chunk of TDO is ever buffered
+		txb_.resize( prfVecLen_ + overhead );
+	} else {
+		txb_.resize( maxVecLen_ + overhead );
+	}
 
-	rp_     = &rxb_[0];
+	rp_     = &rxb_[rxOff_];
 	rl_     = 0;
 	tl_     = 0;
 }
 
 void
-XvcConn::flush()
+XvcConn::send(const uint8_t *p, unsigned long l, bool more)
 {
-int      put;
-uint8_t *p = &txb_[0];
+ssize_t put;
+int     flg = more ? MSG_MORE : 0;
 
-	while ( tl_ > 0 ) {
-		put = write( sd_, p, tl_ );
+	while ( l > 0 ) {
+		put = ::send( sd_, p, l, flg );
 		if ( put <= 0 ) {
 			throw SysErr("Unable to send from socket");
 		}
-		p   += put;
-		tl_ -= put;
+		p += put;
+		l -= put;
 	}
 }
 
+void
+XvcConn::flush()
+{
+	send( &txb_[0], tl_ );
+	tl_ = 0;
+}
+
 void
 XvcConn::run()
 {
@@ -179,10 +358,17 @@ unsigned long off;
 
 	while ( 1 ) {
 
-	// read stuff;
+	// read stuff; XVC is synchronous, i.e., after sending
+	// a reply we most likely have to wait for the next request
 
-	got = read( rp_, chunk_ );
-	if ( got <= 0 ) {
+	rxWant_ = 1;
+	wait();
+	got     = read( rp_, chunk_ );
+	if ( 0 == got ) {
+		// orderly shutdown
+		throw std::runtime_error("Client closed the connection");
+	}
+	if ( got < 0 ) {
 		throw SysErr("Unable to read from socket");
 	}
 
@@ -195,7 +381,7 @@ unsigned long off;
 		if ( 0 == ::memcmp( rp_, "ge", 2 ) ) {
 			fill( 8 );
 
-			drv_->query(); // informs the driver that there is a new connection
+			drv_->query(); // answered from the driver's cache (no round trip)
 
 			tl_ = sprintf( (char*)&txb_[0], "xvcServer_v1.0:%ld\n", maxVecLen_ );
 
@@ -221,7 +407,7 @@ unsigned long off;
 			bump( 11 );
 		} else
 		if ( 0 == ::memcmp( rp_, "sh", 2 ) ) {
-			fill( 10 );
+			fill( SHIFT_HDR_LEN );
 
 			bits = 0;
 			for ( got = 9; got >=6; got-- ) {
@@ -231,15 +417,21 @@ unsigned long off;
 			if ( bytes > maxVecLen_ ) {
 				throw ProtoErr("Requested bit vector length too big");
 			}
-			bump( 10 );
-			fill( 2*bytes );
+			bump( SHIFT_HDR_LEN );
+
+			nShifts_++;
+			nBits_ += bits;
+
+			vecLen = bytes > prfVecLen_ ? prfVecLen_ : bytes;
 
-			vecLen = bytes > supVecLen_ ? supVecLen_ : bytes;
+			// break into chunks the driver can handle; due to the xvc layout we can only start
+			// working on the first chunk once the full TMS vector plus the first chunk of the TDI
+			// vector are in. In STREAM_SHIFT mode we do so and pass every chunk on as soon as its
+			// TDI slice has arrived; otherwise we wait for the full payload.
+			if ( ! (flags_ & STREAM_SHIFT) ) {
+				fill( 2*bytes );
+			}
 
-			// break into chunks the driver can handle; due to the xvc layout we can't efficiently
-			// start working on a chunk while still waiting for more data to come in (well - we could
-			// but had to have the full TDI vector plus a chunk of the TMS vector in. Thus, we don't
-			// bother...).
 			for ( off = 0, bitsLeft = bits; bitsLeft > 0; bitsLeft -= bitsSent, off += vecLen ) {
 
 				bitsSent = 8*vecLen;
@@ -247,9 +439,20 @@ unsigned long off;
 					bitsSent = bitsLeft;
 				}
 
-				drv_->sendVectors( bitsSent, rp_ + off, rp_ + bytes + off, &txb_[0] + off );
+				if ( (flags_ & STREAM_SHIFT) ) {
+					fill( bytes + off + (bitsSent + 7)/8 );
+				}
+
+				if ( (flags_ & CUT_THROUGH) ) {
+					// TDO of this chunk goes out right away; cork while
+					// more chunks are to follow.
+					drv_->sendVectors( bitsSent, rp_ + off, rp_ + bytes + off, &txb_[0] );
+					send( &txb_[0], (bitsSent + 7)/8, bitsLeft > bitsSent );
+				} else {
+					drv_->sendVectors( bitsSent, rp_ + off, rp_ + bytes + off, &txb_[0] + off );
+				}
 			}
-			tl_ = bytes;
+			tl_ = (flags_ & CUT_THROUGH) ? 0 : bytes;
 
 			bump( 2*bytes );
 		} else {
@@ -18,32 +18,83 @@
 #define XVC_CONNECTION_H
 
 #include <xvcSrv.h>
+#include <xvcBufPool.h>
 
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 
 // Class managing a XVC tcp connection
+//
+// The connection waits for data using an epoll instance which
+// watches the client socket as well as the (non-blocking) listening
+// socket. The latter is registered edge-triggered so that extra
+// connection attempts are rejected without re-arming on every wait.
 
 class XvcConn {
+protected:
 	JtagDriver        *drv_;
 	int                sd_;
 	int                ld_;
+	int                epfd_;
+	// SO_RCVLOWAT currently set on sd_ and max. value we may use
+	unsigned long      rcvLoWat_;
+	unsigned long      maxLoWat_;
+	// number of bytes the current read actually needs
+	unsigned long      rxWant_;
+	// statistics
+	unsigned long      nReads_;
+	unsigned long      nWaits_;
+	unsigned long      nShifts_;
+	unsigned long      nBits_;
 	struct sockaddr_in peer_;
-	// just use vectors to back raw memory; DONT use 'size/resize'
-	// (unfortunately 'resize' fills elements beyond the current 'size'
-	// with zeroes)
-	vector<uint8_t>    rxb_;
+	// raw memory leased from the (process-wide) XvcBufPool; it
+	// is neither zeroed nor faulted in again on reconnect.
+	XvcBuf             rxb_;
 	uint8_t           *rp_;
     unsigned long      rl_;
 	unsigned long      tl_;
 
-	vector<uint8_t>    txb_;
+	XvcBuf             txb_;
 	unsigned long      maxVecLen_;
 	unsigned long      supVecLen_;
 	unsigned long      chunk_;
+	unsigned           flags_;
+	// what the driver reports; shift vectors are passed on in
+	// chunks of 'prfVecLen_'
+	JtagDriver::Caps   drvCaps_;
+	// how long (us) to poll for the rest of a request
+	unsigned           spinUs_;
+	unsigned long      prfVecLen_;
+	// offset of a request in rxb_ (aligns the TMS vector)
+	unsigned long      rxOff_;
 
 public:
-XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768 );
+	// Poll for the rest of a request at most this long (us) if the
+	// driver polls without limit; a client may stall mid-request.
+	static const unsigned SPIN_US      = 1000;
+
+	// Mode flags
+
+	// hand each chunk to the driver as soon as its
+	// TDI slice has arrived (rather than waiting for
+	// the complete 'shift:' payload)
+	static const unsigned STREAM_SHIFT = (1<<0);
+
+	// send the TDO of every chunk to the client as soon as
+	// the driver has it (rather than the full vector at the end)
+	static const unsigned CUT_THROUGH  = (1<<1);
+
+	// use the io_uring front end (if available; see xvcConnUring.h)
+	static const unsigned IO_URING     = (1<<2);
+
+	// "shift:" and the bit count precede the TMS vector
+	static const unsigned SHIFT_HDR_LEN = 10;
+
+XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768, unsigned flags = 0 );
+
+	// create a connection object of the flavor selected by 'flags'
+	static XvcConn *create( int sd, JtagDriver *drv, unsigned long maxVecLen, unsigned flags );
 
 	// fill rx buffer to 'n' octets (from TCP connection)
 	virtual void fill(unsigned long n);
@@ -51,11 +102,25 @@ XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768 );
 	// send tx buffer to TCP connection
 	virtual void flush();
 
+	// send 'l' octets to TCP connection; 'more' indicates
+	// that more data follows shortly (MSG_MORE)
+	virtual void send(const uint8_t *buf, unsigned long l, bool more = false);
+
 	// delegate to read but while blocking make sure to
 	// reject attempts by other clients to connect by accepting
 	// and closing extra connections
     virtual ssize_t read(void *buf, size_t l);
 
+	// block until the client socket is readable (servicing
+	// the listening socket while waiting)
+	virtual void wait();
+
+	// accept and close all pending connection attempts
+	virtual void reject();
+
+	// set SO_RCVLOWAT (if different from the current value)
+	virtual void setRcvLoWat(unsigned long n);
+
 	// discard 'n' octets from rx buffer (mark as consumed)
 	virtual void bump(unsigned long n);
 
@@ -64,6 +129,9 @@ XvcConn( int sd, JtagDriver *drv, unsigned long maxVecLen_ = 32768 );
 
 	virtual void run();
 
+	unsigned long getShifts() const { return nShifts_; }
+	unsigned long getBits()   const { return nBits_;   }
+
 	virtual ~XvcConn();
 };
 
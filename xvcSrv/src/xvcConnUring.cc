@@ -0,0 +1,259 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcConnUring.h>
+
+#ifdef HAVE_LIBURING
+
+#include <poll.h>
+#include <sys/uio.h>
+
+XvcConnUring::XvcConnUring( int sd, JtagDriver *drv, unsigned long maxVecLen, unsigned flags )
+: XvcConn  ( sd, drv, maxVecLen, flags ),
+  useRing_ ( false ),
+  bufsReg_ ( false ),
+  lstnArmd_( false ),
+  txQueued_( false ),
+  txp_     ( 0     ),
+  txl_     ( 0     )
+{
+int st;
+
+	// we never have more than three requests (listen poll, reply, request)
+	// in flight.
+	if ( (st = io_uring_queue_init( 8, &ring_, 0 )) < 0 ) {
+		fprintf(stderr, "WARNING: io_uring not available (%s); falling back to epoll\n", strerror( -st ));
+		return;
+	}
+	useRing_ = true;
+}
+
+XvcConnUring::~XvcConnUring()
+{
+	if ( useRing_ ) {
+		// also unregisters the buffers and cancels the listen poll
+		io_uring_queue_exit( &ring_ );
+	}
+}
+
+void
+XvcConnUring::allocBufs()
+{
+struct iovec iov[2];
+int          st;
+
+	XvcConn::allocBufs();
+
+	if ( ! useRing_ ) {
+		return;
+	}
+
+	if ( bufsReg_ ) {
+		io_uring_unregister_buffers( &ring_ );
+		bufsReg_ = false;
+	}
+
+	iov[RX_BUF_IDX].iov_base = &rxb_[0];
+	iov[RX_BUF_IDX].iov_len  = rxb_.size();
+	iov[TX_BUF_IDX].iov_base = &txb_[0];
+	iov[TX_BUF_IDX].iov_len  = txb_.size();
+
+	// registration may fail due to RLIMIT_MEMLOCK; plain
+	// read/write still work in this case.
+	if ( (st = io_uring_register_buffers( &ring_, iov, sizeof(iov)/sizeof(iov[0]) )) < 0 ) {
+		fprintf(stderr, "WARNING: unable to register io_uring buffers (%s)\n", strerror( -st ));
+	} else {
+		bufsReg_ = true;
+	}
+}
+
+bool
+XvcConnUring::inBuf(const XvcBuf &b, const void *p, unsigned long l)
+{
+const uint8_t *bp = (const uint8_t*)p;
+
+	return bp >= &b[0] && bp + l <= &b[0] + b.size();
+}
+
+struct io_uring_sqe *
+XvcConnUring::getSqe()
+{
+struct io_uring_sqe *sqe;
+
+	if ( ! (sqe = io_uring_get_sqe( &ring_ )) ) {
+		throw std::runtime_error("XvcConnUring: submission queue full");
+	}
+	return sqe;
+}
+
+void
+XvcConnUring::armListen()
+{
+struct io_uring_sqe *sqe = getSqe();
+
+	io_uring_prep_poll_multishot( sqe, ld_, POLLIN );
+	sqe->user_data = TAG_LISTEN;
+	lstnArmd_      = true;
+}
+
+void
+XvcConnUring::wait()
+{
+	// the ring waits as part of 'read'
+	if ( ! useRing_ ) {
+		XvcConn::wait();
+	}
+}
+
+void
+XvcConnUring::send(const uint8_t *buf, unsigned long l, bool more)
+{
+	if ( ! useRing_ ) {
+		XvcConn::send( buf, l, more );
+		return;
+	}
+
+	if ( 0 == l ) {
+		return;
+	}
+
+	// keep ordering if something is queued already
+	if ( txQueued_ ) {
+		XvcConn::send( txp_, txl_ );
+		txQueued_ = false;
+	}
+
+	// Defer the reply and submit it linked to the next read. This is only
+	// safe if the next thing that happens is a read, i.e., if the client
+	// has no further requests pending in our RX buffer (which could produce
+	// another reply into txb_) and if this is the last part of a reply.
+	if ( more || rl_ > 0 || ! inBuf( txb_, buf, l ) ) {
+		XvcConn::send( buf, l, more );
+		return;
+	}
+
+	if ( ! lstnArmd_ ) {
+		// must not end up between the linked reply and read
+		armListen();
+	}
+
+	txp_      = buf;
+	txl_      = l;
+	txQueued_ = true;
+}
+
+ssize_t
+XvcConnUring::read(void *buf, size_t l)
+{
+struct io_uring_sqe *sqe;
+struct io_uring_cqe *cqe;
+int                  st;
+int                  res;
+__u64                tag;
+unsigned             cflg;
+
+	if ( ! useRing_ ) {
+		return XvcConn::read( buf, l );
+	}
+
+	do {
+
+		if ( ! lstnArmd_ ) {
+			armListen();
+		}
+
+		if ( txQueued_ ) {
+			sqe = getSqe();
+			if ( bufsReg_ ) {
+				io_uring_prep_write_fixed( sqe, sd_, txp_, txl_, 0, TX_BUF_IDX );
+			} else {
+				io_uring_prep_write( sqe, sd_, txp_, txl_, 0 );
+			}
+			sqe->flags     |= IOSQE_IO_LINK;
+			sqe->user_data  = TAG_TX;
+			txQueued_       = false;
+		}
+
+		sqe = getSqe();
+		if ( bufsReg_ && inBuf( rxb_, buf, l ) ) {
+			io_uring_prep_read_fixed( sqe, sd_, buf, l, 0, RX_BUF_IDX );
+		} else {
+			io_uring_prep_read( sqe, sd_, buf, l, 0 );
+		}
+		sqe->user_data = TAG_RX;
+
+		nWaits_++;
+		while ( (st = io_uring_submit_and_wait( &ring_, 1 )) < 0 ) {
+			if ( -EINTR != st ) {
+				errno = -st;
+				throw SysErr("io_uring_submit_and_wait failed");
+			}
+		}
+
+		do {
+			while ( (st = io_uring_wait_cqe( &ring_, &cqe )) < 0 ) {
+				if ( -EINTR != st ) {
+					errno = -st;
+					throw SysErr("io_uring_wait_cqe failed");
+				}
+			}
+
+			tag  = cqe->user_data;
+			res  = cqe->res;
+			cflg = cqe->flags;
+
+			io_uring_cqe_seen( &ring_, cqe );
+
+			switch ( tag ) {
+				case TAG_LISTEN:
+					if ( res > 0 ) {
+						reject();
+					}
+					if ( ! (cflg & IORING_CQE_F_MORE) ) {
+						lstnArmd_ = false;
+					}
+					break;
+
+				case TAG_TX:
+					if ( res < 0 ) {
+						errno = -res;
+						throw SysErr("Unable to send from socket");
+					}
+					// a short write breaks the link; send the rest the
+					// old-fashioned way and re-issue the (cancelled) read.
+					if ( (unsigned long)res < txl_ ) {
+						XvcConn::send( txp_ + res, txl_ - res );
+					}
+					break;
+
+				default:
+					break;
+			}
+		} while ( TAG_RX != tag );
+
+	} while ( -ECANCELED == res );
+
+	nReads_++;
+
+	if ( res < 0 ) {
+		errno = -res;
+		return -1;
+	}
+
+	return res;
+}
+
+#endif
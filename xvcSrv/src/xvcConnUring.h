@@ -0,0 +1,77 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_CONNECTION_URING_H
+#define XVC_CONNECTION_URING_H
+
+#include <xvcConn.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+// XVC tcp connection using io_uring.
+//
+// 'rxb_' and 'txb_' are registered with the ring. A reply is not
+// written immediately but queued and linked to the read of the
+// next request; both are then submitted with a single io_uring_enter
+// which also waits for the request to arrive. Extra clients trying
+// to connect are detected by a multishot poll on the listening socket.
+//
+// If the ring cannot be set up (e.g., old kernel or io_uring disabled)
+// then all methods fall back to the XvcConn implementation.
+
+class XvcConnUring : public XvcConn {
+private:
+	struct io_uring    ring_;
+	bool               useRing_;
+	bool               bufsReg_;
+	bool               lstnArmd_;
+	// reply queued but not yet submitted
+	bool               txQueued_;
+	const uint8_t     *txp_;
+	unsigned long      txl_;
+
+	static const __u64 TAG_RX     = 1;
+	static const __u64 TAG_TX     = 2;
+	static const __u64 TAG_LISTEN = 3;
+
+	static const int   RX_BUF_IDX = 0;
+	static const int   TX_BUF_IDX = 1;
+
+	struct io_uring_sqe *getSqe();
+
+	// arm the (multishot) poll on the listening socket
+	void armListen();
+
+	bool   inBuf(const XvcBuf &b, const void *p, unsigned long l);
+
+public:
+	XvcConnUring( int sd, JtagDriver *drv, unsigned long maxVecLen = 32768, unsigned flags = 0 );
+
+	virtual void allocBufs();
+
+	virtual ssize_t read(void *buf, size_t l);
+
+	virtual void wait();
+
+	virtual void send(const uint8_t *buf, unsigned long l, bool more = false);
+
+	virtual ~XvcConnUring();
+};
+
+#endif
+
+#endif
@@ -26,11 +26,32 @@
 #include <unistd.h>
 #include <vector>
 #include <string>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <xvcIlv.h>
 
 using std::vector;
 
 class JtagDumpCtx;
 
+// Observer of the messages a driver exchanges with its target;
+// middleware layers (see xvcDrvLayer.h) install these.
+class JtagXferHook {
+public:
+	// a message with header 'hdr' of 'len' octets is about to be sent;
+	// returning false drops it (as if it were lost in transit; only
+	// honored for a target with memory)
+	virtual bool xferSend(uint32_t hdr, unsigned len) = 0;
+
+	// the reply (header 'rplHdr', 'got' payload octets) to the message
+	// with header 'hdr' arrived 'ns' nanoseconds after it was sent;
+	// 'got' is -1 if it timed out. The default does nothing.
+	virtual void xferDone(uint32_t, uint32_t, int, unsigned long) {}
+
+	virtual ~JtagXferHook() {}
+};
+
 // Abstract JTAG driver -- in most cases you'd want to
 // subclass JtagDriverAxisToJtag if you want to support
 // a new transport.
@@ -46,12 +67,12 @@ public:
 	JtagDriver(int argc, char *const argv[], unsigned debug);
 
 	// set/get debug level
-	void     setDebug(unsigned debug);
+	virtual void setDebug(unsigned debug);
 	unsigned getDebug();
 
     bool     getSniff();
 
-	void     setTestMode(unsigned flags);
+	virtual void setTestMode(unsigned flags);
 
 	virtual void init()
 		= 0;
@@ -92,6 +113,56 @@ public:
 	virtual void
 	dumpInfo(FILE *f = stdout) = 0;
 
+	// How the driver waits for the target: blocking (sleeps until
+	// the reply arrives) or polling (burns a CPU).
+	static const unsigned WAIT_BLOCK = 0;
+	static const unsigned WAIT_POLL  = 1;
+
+	static const unsigned long CHUNK_ANY = (unsigned long)-1;
+
+	// Properties of the driver which the XVC connection takes into
+	// account when it breaks up shift vectors.
+	typedef struct Caps {
+		// chunks (but the last) should be a multiple of 'align_' octets
+		unsigned      align_;
+		// max. number of messages the driver keeps in flight
+		unsigned      maxInFlight_;
+		// TMS/TDI are passed to the transport straight from the
+		// caller's vectors (no interleaving copy)
+		bool          zeroCopy_;
+		// vector size the driver handles best; 0 if it has no
+		// preference (other than 'getMaxVectorSize()'). A driver
+		// which splits vectors itself may prefer longer ones
+		// (CHUNK_ANY: as long as possible).
+		unsigned long chunk_;
+		// WAIT_BLOCK or WAIT_POLL
+		unsigned      waitMode_;
+		// WAIT_POLL: how long (us) the driver polls before it
+		// blocks; 0 if it polls until the reply arrives
+		unsigned      spinUs_;
+	} Caps;
+
+	// Obtain the driver's properties (valid once the target has been
+	// queried); the default is: byte alignment, one message in flight,
+	// no zero-copy, no preferred chunk size, blocking wait.
+	virtual void
+	getCaps(Caps *caps);
+
+	// periodically verify (in the background, while idle) that the
+	// target is alive; 0 disables. Drivers that don't support this
+	// ignore the request.
+	virtual void
+	setHealthProbe(unsigned periodMs);
+
+	// install an observer of the messages exchanged with the target;
+	// returns false if the driver doesn't support this.
+	virtual bool
+	addXferHook(JtagXferHook *hook);
+
+	// the server calls this when a client disconnected
+	virtual void
+	connDone();
+
 	virtual ~JtagDriver();
 
     static void usage(); // to be implemented by subclass
@@ -170,6 +241,27 @@ public:
 };
 
 
+// RAII mutex lock
+class MtxLock {
+private:
+	pthread_mutex_t *m_;
+
+	MtxLock(const MtxLock&);
+	MtxLock & operator=(const MtxLock&);
+
+public:
+	MtxLock(pthread_mutex_t *m)
+	: m_( m )
+	{
+		pthread_mutex_lock( m_ );
+	}
+
+	~MtxLock()
+	{
+		pthread_mutex_unlock( m_ );
+	}
+};
+
 // Exceptions
 
 // library/syscall errors (yielding and 'errno' -- which is converted to a message)
@@ -225,6 +317,38 @@ public:
 //
 // If a timeout occurs then 'xfer' must throw a TimeoutErr().
 //
+// Scatter-gather (optional):
+//
+// A driver may implement 'xferv()' which takes the message as an
+// iovec list (header, then TMS and TDI words pointing directly into
+// the caller's vectors) and return 'true' from 'canXferv()'; this
+// saves interleaving the vectors into a buffer first. The default
+// 'xferv()' gathers into a buffer and calls 'xfer()'.
+//
+// Pipelining (optional):
+//
+// A transport which can have several messages in flight (e.g., UDP)
+// may implement 'submit()' (send w/o waiting for a reply), 'complete()'
+// (receive the next reply; like the receiving part of 'xfer()') and
+// 'getMaxMsgVectorSize()' and return 'true' from 'canPipeline()'.
+// If the target supports protocol version 1 and advertises multiple
+// reply buffers then up to that many messages are kept in flight and
+// 'getMaxVectorSize()' should return (a multiple of) 'getWindow()' times
+// 'getMaxMsgVectorSize()'.
+//
+// A reliable transport (target without memory) which delivers the replies
+// in order may implement 'submit()' and 'complete()' as well and return
+// the number of messages it can hold from 'getQueueDepth()'. The next
+// message is then queued while the target executes the current one (no
+// protocol version 1 support is required; nothing is ever retransmitted).
+// 'getMaxVectorSize()' should again return 'getWindow()' times
+// 'getMaxMsgVectorSize()'.
+//
+// 'submit()' may defer sending a message (e.g., to send several of them
+// with a single system call); the message buffer is not modified until
+// it is acknowledged. 'complete()' must send everything that was deferred
+// before it waits for a reply.
+//
 class JtagDriverAxisToJtag : public JtagDriver {
 protected:
 	typedef uint32_t Header;
@@ -234,6 +358,8 @@ protected:
 
 private:
 	unsigned        wordSize_;
+	// 'wordSize_' has been reported by the target
+	bool            wszKnown_;
 	unsigned        memDepth_;
 
 	vector<uint8_t> txBuf_;
@@ -241,15 +367,163 @@ private:
 
 	unsigned        bufSz_;
 	unsigned        retry_;
+	unsigned        maxRetry_;
 
 	Xid             xid_;
 
 	uint32_t        periodNs_;
 
+	// negotiated protocol version and the highest one we try
+	Header          pvers_;
+	Header          maxVers_;
+	// reply buffers advertised by the target and max. number
+	// of messages we keep in flight
+	unsigned        nBufs_;
+	unsigned        window_;
+	unsigned        maxWindow_;
+	vector<uint8_t> winBuf_;
+	unsigned long   nRetrans_;
+
+	// TMS/TDI interleave kernel and shift message formatter for
+	// the current word size; both are selected once by doQuery().
+	// The formatter stores the TMS/TDI words past the header (of 'hsz'
+	// octets) which the caller has already stored.
+	typedef unsigned (*FmtFunc)(uint8_t *buf, unsigned wsz, unsigned hsz, unsigned long bytes, const uint8_t *tms, const uint8_t *tdi, IlvFunc ilv);
+
+	IlvFunc         ilv_;
+	FmtFunc         fmt_;
+
+	// formatter for word size WSZ (any size if WSZ is 0)
+	template <unsigned WSZ>
+	static unsigned fmtShiftW(uint8_t *buf, unsigned wsz, unsigned hsz, unsigned long bytes, const uint8_t *tms, const uint8_t *tdi, IlvFunc ilv);
+
+	static FmtFunc  fmtSelect(unsigned wsz);
+
+	// compressed (run-length encoded) shift messages: supported
+	// by the target and not disabled by the driver
+	bool            rle_;
+	bool            rleEna_;
+	// decoding buffer
+	vector<uint8_t> rleBuf_;
+	// receive buffer for out-of-order pipelined replies
+	vector<uint8_t> rplBuf_;
+	unsigned long   nRleTx_;
+	unsigned long   nRleRx_;
+
+	// idle runs are clocked by CMD_C: supported by the target and
+	// not disabled by the driver; min. run length in cycles (0: auto)
+	bool            clk_;
+	bool            clkEna_;
+	unsigned long   clkMin_;
+	// TAP state (tracked from TMS) at the start of the next vector
+	uint8_t         tapState_;
+	unsigned long   nClkCmds_;
+
+	// target can set its TCK period (version 2 with CAP_SETTCK);
+	// the period last requested by the tool (0: none) is sent
+	// with every query so that it survives a target reset.
+	bool            tck_;
+	uint32_t        tckReqNs_;
+
+	// capabilities shared with the target (version 1 and up)
+	uint32_t        tgtCaps_;
+
+	// scatter-gather list and gather buffer
+	vector<struct iovec> iov_;
+	vector<uint8_t>      gthBuf_;
+
+	// middleware layers observing the messages; nothing
+	// but 'hooked_' is looked at if there are none.
+	vector<JtagXferHook*> hooks_;
+	bool            hooked_;
+
+	// query results are cached; 'query()' only contacts the
+	// target if the cache is invalid.
+	bool            cacheValid_;
+
+	// serializes transactions (the health probe runs in its
+	// own thread)
+	pthread_mutex_t xferMtx_;
+
+	pthread_t       probeT_;
+	unsigned        probeMs_;
+	bool            probeRun_;
+	bool            tgtLost_;
+	unsigned long   tgtResets_;
+	struct timespec lastXfer_;
+
 	Header newXid();
 
+	// contact the target and update the cached parameters
+	unsigned long doQuery();
+
+	static void  *probeThread(void *arg);
+
+	// probe the target (if idle); returns false if the thread should exit
+	bool          probe();
+
 	Header   mkQuery();
-	Header   mkShift(unsigned len);
+	Header   mkShift(unsigned len, Header cmd = CMD_S);
+
+	// capabilities we announce in a version 2 query
+	uint32_t hostCaps();
+
+	// size of the header of a command carrying 'len' bits/cycles
+	unsigned shiftHdrSize(unsigned long len);
+
+	// store the header of such a command in 'buf'; returns its size
+	unsigned putShift(uint8_t *buf, unsigned long len, Header cmd = CMD_S);
+
+	// longest vector (bits/cycles) a single command may carry
+	unsigned long maxShiftLen();
+
+	// throw if 'hdr' is an error reply
+	void     chkErr(Header hdr);
+
+	// let the hooks know that a message is sent (recording the time
+	// in 'then'); returns false if one of them drops it.
+	bool     hookSend(Header hdr, unsigned len, struct timespec *then);
+	void     hookDone(Header hdr, Header rplHdr, int got, const struct timespec *then);
+
+	// 'xferv()' observed by the hooks
+	int      xfervHooked(Header hdr, const struct iovec *iov, unsigned iovcnt, uint8_t *rxb, unsigned size);
+
+	// format a shift message into 'buf'; returns the message size
+	unsigned fmtShift(uint8_t *buf, unsigned long bits, uint8_t *tms, uint8_t *tdi);
+
+	// format a compressed shift message of at most 'maxBytes' into
+	// 'buf'; returns the message size or 0 if the encoded message
+	// would not be shorter than the plain one or exceed 'maxBytes'.
+	unsigned fmtShiftZ(uint8_t *buf, unsigned long bits, uint8_t *tms, uint8_t *tdi, unsigned long maxBytes);
+
+	// decode a compressed reply of 'got' octets at 'src' into the
+	// TDO vector 'dst' ('bytes' long); returns the TDO length. Plain
+	// replies are just moved to 'dst' (if necessary).
+	int      decodeReply(Header hdr, uint8_t *dst, unsigned long bytes, uint8_t *src, int got);
+
+	// longest vector a compressed message may carry
+	unsigned long rleMaxVectorSize();
+
+	// build the iovec list for a shift message (header in 'hdr');
+	// returns the number of elements or 0 if there are too many.
+	unsigned fmtShiftv(uint8_t *hdr, unsigned long bits, uint8_t *tms, uint8_t *tdi);
+
+	// shift a vector of several messages keeping up to 'window_'
+	// of them in flight (go-back-N; the target executes them in
+	// sequence and plays back what it has executed already)
+	void     sendVectorsPipelined(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+
+	// shift (part of) a vector by whichever method suits it best
+	void     sendSegment(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+
+	// find the next word-aligned idle run of at least 'minBytes'
+	// starting at octet 'off' while tracking the TAP state; returns
+	// its offset and its length in '*plen' (0 and the vector size
+	// if there is none).
+	unsigned long findIdleRun(unsigned long bits, const uint8_t *tms, const uint8_t *tdi, unsigned long off, unsigned long minBytes, unsigned long *plen);
+
+	// clock 'cycles' with constant TMS/TDI (CMD_C messages)
+	void     sendClock(unsigned long cycles, unsigned tms, unsigned tdi);
 
 protected:
 
@@ -257,15 +531,95 @@ protected:
 
 	static       Header   getHdr(uint8_t *buf);
 
-	static       uint32_t getw32(uint8_t *buf);
-	static       void     setw32(uint8_t *buf, uint32_t w, unsigned l = sizeof(uint32_t));
+	static       uint32_t getw32(uint8_t *buf)
+	{
+	uint32_t w;
+		memcpy( &w, buf, sizeof(w) );
+		if ( ! isLE() ) {
+			w = __builtin_bswap32( w );
+		}
+		return w;
+	}
+
+	static       void     setw32(uint8_t *buf, uint32_t w, unsigned l = sizeof(uint32_t))
+	{
+		if ( ! isLE() ) {
+			w = __builtin_bswap32( w );
+		}
+		memcpy( buf, &w, l >= sizeof(w) ? sizeof(w) : l );
+	}
 
 
+	// Protocol version 1 adds pipelining: the reply to a query
+	// carries a payload word
+	//
+	//   [ 7: 0] number of reply buffers
+	//
+	//   [    8] target accepts and sends compressed shift
+	//           commands (CMD_Z)
+	//
+	//   [    9] target accepts clock commands (CMD_C)
+	//
+	//   [   10] target can set its TCK period (version 2)
+	//
+	// and the target executes shift commands strictly in XID
+	// sequence (XID 0 is a valid ID in this version). A command
+	// with an unexpected XID is dropped unless its reply is still
+	// in one of the buffers (which is then played back). A query
+	// resets the sequence.
+	//
+	// Version 2 adds
+	//  - the host's capabilities (same bits) in the 32 bits following
+	//    the query header and the requested TCK period in ns (0: keep)
+	//    in the next 32 bits; the target replies with the capabilities
+	//    it shares, a second payload word holding the memory depth
+	//    (the 16-bit field in the reply header may be too small) and
+	//    a third one with the (new) TCK period in ns (0: unknown).
+	//  - a long header for commands carrying a length (S, Z, C): if
+	//    LEN_MASK is all ones then the length - 1 is in the next word.
 	static const Header   PVER0 = 0x00000000;
-	static const Header   PVERS = PVER0;
+	static const Header   PVER1 = 0x40000000;
+	static const Header   PVER2 = 0x80000000;
+	// highest version we support
+	static const Header   PVERS = PVER2;
 	static const Header   CMD_Q = 0x00000000;
 	static const Header   CMD_S = 0x10000000;
 	static const Header   CMD_E = 0x20000000;
+	// shift with run-length encoded vectors (version 1 with CAP_RLE)
+	static const Header   CMD_Z = 0x30000000;
+	// clock N cycles with constant TMS/TDI (version 1 with CAP_CLOCK);
+	// shares the code of CMD_E which is only ever sent by the target.
+	// The reply is told apart from an error by CLK_ACK in [19:0]; any
+	// other reply is an error.
+	static const Header   CMD_C = 0x20000000;
+	static const Header   CLK_ACK = 0x00080000;
+
+	// capabilities in the version 1 query reply payload
+	static const uint32_t CAP_NBUFS_MASK = 0x000000ff;
+	static const uint32_t CAP_RLE        = 0x00000100;
+	static const uint32_t CAP_CLOCK      = 0x00000200;
+	static const uint32_t CAP_SETTCK     = 0x00000400;
+	// version 2: a message may be carried by several datagrams
+	static const uint32_t CAP_SEG        = 0x00000800;
+
+	// A segment frame (version "11" which no message uses) carries a
+	// piece of a message (or reply) which doesn't fit into a datagram.
+	// The (32-bit) frame header is followed by a 32-bit word holding
+	// the octet offset of the piece; a status frame has a zero offset
+	// followed by a bitmap (MAX_SEGS bits) of the frames the sender
+	// holds.
+	//   [31:30] "11"
+	//   [29:28] "00": data, "01": status
+	//   [   27] last frame of the message (data)
+	//   [23:16] transaction ID of the message
+	//   [15: 8] frame number (data)
+	static const Header   SEG_FRAME      = 0xc0000000;
+	static const Header   SEG_STATUS     = 0x10000000;
+	static const Header   SEG_LAST       = 0x08000000;
+	static const unsigned SEG_XID_SHIFT  = 16;
+	static const unsigned SEG_NUM_SHIFT  =  8;
+	static const unsigned MAX_SEGS       = 256;
+	static const unsigned SEG_HSIZE      = 2*sizeof(Header);
 
 	static const Header   VRS_MASK  = 0xc0000000;
 	static const Header   CMD_MASK  = 0x30000000;
@@ -285,8 +639,17 @@ protected:
 	static uint32_t      getCmd(Header x);
 	static unsigned      getErr(Header x);
 	static unsigned long getLen(Header x);
+	// length of the (S, Z or C) command in 'buf' from the short or
+	// long header; the header size is stored in '*phsz'
+	static unsigned long getMsgLen(uint8_t *buf, unsigned wsz, unsigned *phsz = 0);
 	static Header        getVrs(Header x);
 
+	static bool          isClkAck(Header x);
+	static bool          isSegFrame(Header x);
+	static Header        mkSegHdr(Xid xid, unsigned num, Header flags = 0);
+	static Xid           getSegXid(Header x);
+	static unsigned      getSegNum(Header x);
+
 	static Header mkQueryReply
 	(
 		Header   protoVers,
@@ -306,14 +669,23 @@ protected:
 
     static uint32_t encPerNs(uint32_t);
 
+	// known at compile time with any recent gcc/clang so that
+	// the byte swapping is folded away on little-endian hosts
 	static int isLE()
 	{
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+		return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
 	static const union { uint8_t c[2]; uint16_t s; } u = { s: 1 };
 		return !!u.c[0];
+#endif
 	}
 
 	static const uint32_t UNKNOWN_PERIOD = 0;
 
+	// upper limit for messages in flight (XIDs are 8 bits)
+	static const unsigned MAX_WINDOW     = 64;
+
 	static double         REF_FREQ_HZ()
 	{
 		return 200.0E6;
@@ -325,6 +697,40 @@ protected:
 	virtual unsigned getMemDepth();
 	virtual uint32_t getPeriodNs();
 
+	// number of messages kept in flight (1 unless pipelining)
+	virtual unsigned getWindow();
+
+	// limit the number of messages in flight
+	virtual void     setMaxWindow(unsigned maxWindow);
+
+	// use compressed shift messages if the target supports them (default)
+	virtual void     setCompression(bool enable);
+
+	// clock idle runs of at least 'minCycles' by command (0: one
+	// message worth; CLK_RUN_OFF: don't, default). The TDO of such a
+	// run is not recorded but reported as zeros.
+	static const unsigned long CLK_RUN_OFF = (unsigned long)-1;
+	virtual void     setClockRun(unsigned long minCycles);
+
+	// highest protocol version to try (default: PVERS)
+	virtual void     setMaxVersion(unsigned vers);
+
+	// capabilities the transport adds to the ones announced in a
+	// version 2 query (e.g., CAP_SEG); default: none
+	virtual uint32_t transportCaps();
+
+	// capabilities the target shares with us (valid after a query)
+	virtual uint32_t getTargetCaps();
+
+	// store the query 'doQuery()' would send in 'buf' (at least
+	// 3*sizeof(Header) octets); returns its size. The target ignores
+	// any padding, thus a padded query probes the path MTU.
+	virtual unsigned fmtQuery(uint8_t *buf);
+
+	// number of retransmissions before a transfer fails (default 5;
+	// targets without memory are never retried)
+	virtual void     setMaxRetries(unsigned maxRetry);
+
 public:
 
 	JtagDriverAxisToJtag( int argc, char *const argv[], unsigned debug = 0 );
@@ -340,6 +746,33 @@ public:
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size ) = 0;
 
+	// scatter-gather support (see above)
+	virtual bool
+	canXferv();
+
+	virtual int
+	xferv( const struct iovec *iov, unsigned iovcnt, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	// pipelining support (see above); the default implementations
+	// don't support it.
+	virtual bool
+	canPipeline();
+
+	virtual void
+	submit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	// max. vector size of a single message
+	virtual unsigned long
+	getMaxMsgVectorSize();
+
+	// number of messages a reliable transport can hold (see above;
+	// default: 1, i.e., no queueing)
+	virtual unsigned
+	getQueueDepth();
+
 	// Transfer with retry/timeout.
 	// 'txBytes' are transmitted from the TX buffer 'txb'.
 	// The message header is received into '*phdr', payload (of up to 'sizeBytes') into 'rxb'.
@@ -347,18 +780,36 @@ public:
 	virtual int
 	xferRel( uint8_t *txb, unsigned txBytes, Header *phdr, uint8_t *rxb, unsigned sizeBytes );
 
-	// XVC query ("getinfo")
+	// Same as 'xferRel' but the message is given by an iovec list
+	virtual int
+	xferRelv( const struct iovec *iov, unsigned iovcnt, Header *phdr, uint8_t *rxb, unsigned sizeBytes );
+
+	// XVC query ("getinfo"); answered from the cache
+	// if possible (see 'setHealthProbe()')
 	virtual unsigned long
 	query();
 
+	virtual void
+	setHealthProbe(unsigned periodMs);
+
+	virtual bool
+	addXferHook(JtagXferHook *hook);
+
 	virtual uint32_t
 	setPeriodNs(uint32_t newPeriod);
 
 	// XVC send vectors ("shift")
 	virtual void sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
 
+	// word alignment, window, scatter-gather; with a window of
+	// several messages whole vectors are preferred so that it
+	// doesn't drain between chunks.
+	virtual void getCaps(Caps *caps);
+
 	virtual void dumpInfo(FILE *f);
 
+	virtual ~JtagDriverAxisToJtag();
+
 	static void usage();
 };
 
@@ -376,6 +827,10 @@ public:
 
 	virtual int getSd();
 
+	// set SO_BUSY_POLL (usec); prints a warning and returns
+	// false if this fails (raising the value needs CAP_NET_ADMIN)
+	virtual bool setBusyPoll(unsigned us);
+
 	virtual ~SockSd();
 };
 
@@ -92,6 +92,13 @@ JtagDriverZynqAxiDbgBridgeIP::getMaxVectorSize()
 	return maxVec_;
 }
 
+void
+JtagDriverZynqAxiDbgBridgeIP::getCaps(Caps *caps)
+{
+	JtagDriverAxisToJtag::getCaps( caps );
+	caps->waitMode_ = WAIT_POLL;
+}
+
 int
 JtagDriverZynqAxiDbgBridgeIP::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
 {
@@ -50,6 +50,10 @@ public:
 	virtual unsigned long
 	getMaxVectorSize();
 
+	// polls the CSR (sleeps only if that takes long)
+	virtual void
+	getCaps(Caps *caps);
+
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
 
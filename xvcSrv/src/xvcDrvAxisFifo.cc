@@ -19,17 +19,21 @@
 
 JtagDriverZynqFifo::JtagDriverZynqFifo(int argc, char *const argv[], const char *devnam)
 : JtagDriverAxisToJtag( argc, argv ),
-  map_   ( devnam ),
-  useIrq_( true   )
+  map_      ( devnam ),
+  useIrq_   ( true   ),
+  queue_    ( true   ),
+  pending_  ( 0      ),
+  rdyShared_( false  )
 {
 uint32_t sizVal;
 unsigned long maxBytes;
 unsigned long maxWords;
 int           opt;
 
-	while ( (opt = getopt(argc, argv, "i")) > 0 ) {
+	while ( (opt = getopt(argc, argv, "iQ")) > 0 ) {
 		switch ( opt ) {
 			case 'i': useIrq_ = false; printf("Interrupts disabled\n"); break;
+			case 'Q': queue_  = false;                                break;
 			default:
 				fprintf( stderr,"Unknown driver option -%c\n", opt );
 				throw std::runtime_error("Unknown driver option");
@@ -49,6 +53,9 @@ int           opt;
 	maxBytes = (maxWords - 1) * wrdSiz_;
 
     maxVec_ = maxBytes/2;
+
+	// two messages (each with a header word) must fit
+	maxMsgVec_ = ((maxWords - 2)/4) * wrdSiz_;
 }
 
 JtagDriverZynqFifo::~JtagDriverZynqFifo()
@@ -95,6 +102,9 @@ JtagDriverZynqFifo::reset()
 {
 int set = 0;
 
+	pending_   = 0;
+	rdyShared_ = false;
+
 	o32( RX_RST_IDX, RST_MAGIC );
 	o32( TX_RST_IDX, RST_MAGIC );
 	if ( useIrq_ ) {
@@ -135,34 +145,73 @@ JtagDriverZynqFifo::init()
 unsigned long
 JtagDriverZynqFifo::getMaxVectorSize()
 {
-	return maxVec_;
+	return getMaxMsgVectorSize() * getWindow();
 }
 
-int
-JtagDriverZynqFifo::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+unsigned long
+JtagDriverZynqFifo::getMaxMsgVectorSize()
+{
+	return getWindow() > 1 ? maxMsgVec_ : maxVec_;
+}
+
+unsigned
+JtagDriverZynqFifo::getQueueDepth()
+{
+	// the next message waits in the TX FIFO while the
+	// current one executes
+	return queue_ && maxMsgVec_ > 0 ? 2 : 1;
+}
+
+void
+JtagDriverZynqFifo::getCaps(Caps *caps)
+{
+	JtagDriverAxisToJtag::getCaps( caps );
+	if ( ! useIrq_ ) {
+		caps->waitMode_ = WAIT_POLL;
+	}
+}
+
+void
+JtagDriverZynqFifo::submit( uint8_t *txb, unsigned txBytes )
 {
 unsigned txWords   = (txBytes + 3)/4;
 uint32_t lastBytes = txBytes - 4*(txWords - 1);
 unsigned i;
-unsigned got, min, minw, rem;
 uint32_t w;
 
-	if ( hsize % 4 != 0 ) {
-		throw std::runtime_error("zynq FIFO only supports word-lengths that are a multiple of 4");
-	}
-
 	for ( i=0; i<txWords; i++ ) {
 		memcpy( &w, &txb[4*i], 4 );
 		o32( TX_DAT_IDX, w );
 	}
 	o32( TX_END_IDX, lastBytes );
+	pending_++;
+}
+
+int
+JtagDriverZynqFifo::complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+unsigned i;
+unsigned got, min, minw, rem;
+uint32_t w;
+
+	if ( hsize % 4 != 0 ) {
+		throw std::runtime_error("zynq FIFO only supports word-lengths that are a multiple of 4");
+	}
 
+	// if this reply arrived while we were reading the previous
+	// one then we have cleared its 'ready' flag already; it is in the
+	// FIFO though.
 	while ( ! (i32( RX_STA_IDX ) & (1<<RX_RDY_SHF)) ) {
+		if ( rdyShared_ && i32( RX_OCC_IDX ) ) {
+			break;
+		}
 		wait();
 	}
 	/* clear status */
 	o32( RX_STA_IDX, (1<<RX_RDY_SHF) );
 
+	rdyShared_ = ( pending_ > 0 && --pending_ > 0 );
+
 	got = i32( RX_CNT_IDX );
 
 	if ( 0 == got ) {
@@ -211,11 +260,19 @@ uint32_t w;
 	return min;
 }
 
+int
+JtagDriverZynqFifo::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+	submit( txb, txBytes );
+	return complete( hdbuf, hsize, rxb, size );
+}
+
 void
 JtagDriverZynqFifo::usage()
 {
-	printf("  Axi Stream Fifo Driver options: [-i]\n");
+	printf("  Axi Stream Fifo Driver options: [-iQ]\n");
 	printf("  -i          : disable interrupts (use polled mode)\n");
+	printf("  -Q          : don't queue the next message while one executes\n");
 }
 
 static DriverRegistrar<JtagDriverZynqFifo> r("zynqAxis");
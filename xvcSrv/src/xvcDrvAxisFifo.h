@@ -45,8 +45,15 @@ private:
 	MemMap<uint32_t>  map_;
 
 	unsigned long     maxVec_;
+	// max. vector of a message when two are queued
+	unsigned long     maxMsgVec_;
     unsigned          wrdSiz_;
     bool              useIrq_;
+    bool              queue_;
+	// messages submitted but not completed; a reply may have
+	// arrived before we cleared the 'ready' flag of the previous one
+	unsigned          pending_;
+	bool              rdyShared_;
 
 public:
 
@@ -66,6 +73,22 @@ public:
 	virtual unsigned long
 	getMaxVectorSize();
 
+	virtual unsigned long
+	getMaxMsgVectorSize();
+
+	virtual unsigned
+	getQueueDepth();
+
+	// polls unless interrupts are used
+	virtual void
+	getCaps(Caps *caps);
+
+	virtual void
+	submit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
 
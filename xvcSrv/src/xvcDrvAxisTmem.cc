@@ -33,8 +33,12 @@ JtagDriverTmemFifo::JtagDriverTmemFifo(int argc, char *const argv[], const char
   toscaSpace_         ( TOSCA_USER2      ),
   toscaBase_          ( 0x200000         ),
   maxVec_             ( 128              ),
+  maxMsgVec_          ( 0                ),
   wrdSiz_             ( sizeof(uint32_t) ),
   irqFd_              ( - 1              ),
+  queue_              ( true             ),
+  pending_            ( 0                ),
+  nSubmit_            ( 0                ),
   bitBang_            ( false            ),
   logBscn_            ( false            ),
   doSleep_            ( false            ),
@@ -61,11 +65,12 @@ const char   *irqfn = 0;
 		throw std::runtime_error("TMEM Device not found");
 	}
 
-	while ( (opt = getopt(argc, argv, "i:bl")) > 0 ) {
+	while ( (opt = getopt(argc, argv, "i:blQ")) > 0 ) {
 		switch ( opt ) {
 			case 'b': bitBang_ = true;          break;
 			case 'l': logBscn_ = true;          break;
 			case 'i': irqfn    = optarg;        break;
+			case 'Q': queue_   = false;         break;
 			default:
 				fprintf( stderr,"Unknown driver option -%c\n", opt );
 				throw std::runtime_error("Unknown driver option");
@@ -131,6 +136,9 @@ const char   *irqfn = 0;
 
 	maxVec_ = maxBytes/2;
 
+	// two messages (each with a header word) must fit
+	maxMsgVec_ = ((maxWords - 2)/4) * wrdSiz_;
+
 	reset();
 }
 
@@ -185,6 +193,8 @@ JtagDriverTmemFifo::reset()
 int      set = 0;
 uint32_t csr;
 
+	pending_ = 0;
+
 	/* Do this first; resets the internal registers, too! */
 	if ( ! useSdes_ ) {
 		o32( FIFO_CSR_IDX, FIFO_CSR_RST );
@@ -315,7 +325,29 @@ JtagDriverTmemFifo::init()
 unsigned long
 JtagDriverTmemFifo::getMaxVectorSize()
 {
-	return maxVec_;
+	return getMaxMsgVectorSize() * getWindow();
+}
+
+unsigned long
+JtagDriverTmemFifo::getMaxMsgVectorSize()
+{
+	return getWindow() > 1 ? maxMsgVec_ : maxVec_;
+}
+
+unsigned
+JtagDriverTmemFifo::getQueueDepth()
+{
+	// the serdes and bit-bang interfaces are synchronous
+	return queue_ && ! bitBang_ && ! useSdes_ && maxMsgVec_ > 0 ? QUEUE_DEPTH : 1;
+}
+
+void
+JtagDriverTmemFifo::getCaps(Caps *caps)
+{
+	JtagDriverAxisToJtag::getCaps( caps );
+	if ( irqFd_ < 0 ) {
+		caps->waitMode_ = WAIT_POLL;
+	}
 }
 
 int
@@ -330,17 +362,18 @@ JtagDriverTmemFifo::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsign
 
 int
 JtagDriverTmemFifo::xferFifo( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+	submit( txb, txBytes );
+	return complete( hdbuf, hsize, rxb, size );
+}
+
+void
+JtagDriverTmemFifo::submit( uint8_t *txb, unsigned txBytes )
 {
 unsigned txWords   = (txBytes + 3)/4;
 uint32_t lastBytes = txBytes - 4*(txWords - 1);
 unsigned i;
-unsigned got, min, minw, rem;
 uint32_t w;
-uint32_t csr;
-
-	if ( hsize % 4 != 0 ) {
-		throw std::runtime_error("AXIS2TMEM FIFO only supports word-lengths that are a multiple of 4");
-	}
 
 	if ( lastBytes ) {
 		txWords--;
@@ -357,12 +390,42 @@ uint32_t csr;
 
 	o32( FIFO_CSR_IDX, i32( FIFO_CSR_IDX ) | FIFO_CSR_EOFO );
 
+	// a shift reply has a header word and a TDO word for
+	// every TMS/TDI pair
+	rplBytes_[ (nSubmit_++) % QUEUE_DEPTH ] = wrdSiz_ + (txBytes - wrdSiz_)/2;
+	pending_++;
+}
+
+int
+JtagDriverTmemFifo::complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+unsigned i;
+unsigned got, min, minw, rem;
+uint32_t w;
+uint32_t csr;
+bool     queued;
+
+	if ( hsize % 4 != 0 ) {
+		throw std::runtime_error("AXIS2TMEM FIFO only supports word-lengths that are a multiple of 4");
+	}
+
 	while ( ( (csr = i32( FIFO_CSR_IDX )) & FIFO_CSR_EMPI ) ) {
 		wait();
 	}
 
 	got = ( (csr >> FIFO_CSR_NWRDS) & FIFO_CSR_NWRDM ) * wrdSiz_;
 
+	// don't consume the reply to a queued message
+	if ( (queued = pending_ > 1) ) {
+		i = rplBytes_[ (nSubmit_ - pending_) % QUEUE_DEPTH ];
+		if ( got > i ) {
+			got = i;
+		}
+	}
+	if ( pending_ > 0 ) {
+		pending_--;
+	}
+
 	if ( 0 == got ) {
 		throw ProtoErr("Didn't receive enough data for header");
 	}
@@ -376,6 +439,13 @@ uint32_t csr;
 		memcpy( hdbuf + i, &w, 4 );
 		got   -= 4;
 	}
+
+	// an error reply is just the header; what follows
+	// belongs to the reply to the queued message
+	if ( queued && getErr( getHdr( hdbuf ) ) ) {
+		got = 0;
+	}
+
 	min  = got;
 
 	if ( size < min ) {
@@ -524,11 +594,12 @@ printf("%08x\n", (unsigned long)hdr);
 void
 JtagDriverTmemFifo::usage()
 {
-	printf("  Axi Stream <-> TMEM Fifo Driver options: [-i]\n");
+	printf("  Axi Stream <-> TMEM Fifo Driver options: [-i] [-Q]\n");
 	printf("  -t <aspace>:<base_address>, e.g., -t USER2:0x200000\n");
 	printf("  -i <irq_file_name>        , e.g., -i /dev/toscauserevent1.13 (defaults to polled mode)\n");
 	printf("  -b                          use bit-bang interface (for debugging)\n");
 	printf("  -l                          use bit-bang interface and log BSCAN signals\n");
+	printf("  -Q                          don't queue the next message while one executes\n");
 }
 
 static DriverRegistrar<JtagDriverTmemFifo> r("tmem");
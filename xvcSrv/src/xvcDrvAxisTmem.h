@@ -70,9 +70,21 @@ private:
 	unsigned long         toscaBase_;
 
 	unsigned long         maxVec_;
+	// max. vector of a message when two are queued
+	unsigned long         maxMsgVec_;
 	unsigned              wrdSiz_;
 	int                   irqFd_ ;
 
+	// queue the next message while one executes (FIFO interface);
+	// the word count of the RX FIFO may include the next reply so
+	// we remember the expected size of every outstanding one.
+	static const unsigned QUEUE_DEPTH = 2;
+
+	bool                  queue_;
+	unsigned              pending_;
+	unsigned              nSubmit_;
+	unsigned              rplBytes_[QUEUE_DEPTH];
+
 
 	bool                  bitBang_;
 	bool                  useSdes_;
@@ -104,6 +116,23 @@ public:
 	virtual unsigned long
 	getMaxVectorSize();
 
+	virtual unsigned long
+	getMaxMsgVectorSize();
+
+	virtual unsigned
+	getQueueDepth();
+
+	// polls unless interrupts are used
+	virtual void
+	getCaps(Caps *caps);
+
+	// split-phase transfer (FIFO interface only)
+	virtual void
+	submit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
 	virtual int
 	xferFifo( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
 
@@ -0,0 +1,396 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcDrvLayer.h>
+#include <stdlib.h>
+
+JtagDriverLayer::JtagDriverLayer(JtagDriver *inner)
+: JtagDriver( 0, 0, inner->getDebug() ),
+  inner_    ( inner                   )
+{
+}
+
+JtagDriverLayer::~JtagDriverLayer()
+{
+	delete inner_;
+}
+
+void
+JtagDriverLayer::setDebug(unsigned debug)
+{
+	JtagDriver::setDebug( debug );
+	inner_->setDebug( debug );
+}
+
+void
+JtagDriverLayer::setTestMode(unsigned flags)
+{
+	JtagDriver::setTestMode( flags );
+	inner_->setTestMode( flags );
+}
+
+void
+JtagDriverLayer::init()
+{
+	inner_->init();
+}
+
+unsigned long
+JtagDriverLayer::query()
+{
+	return inner_->query();
+}
+
+unsigned long
+JtagDriverLayer::getMaxVectorSize()
+{
+	return inner_->getMaxVectorSize();
+}
+
+uint32_t
+JtagDriverLayer::setPeriodNs(uint32_t newPeriod)
+{
+	return inner_->setPeriodNs( newPeriod );
+}
+
+void
+JtagDriverLayer::sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+{
+	inner_->sendVectors( bits, tms, tdi, tdo );
+}
+
+void
+JtagDriverLayer::dumpInfo(FILE *f)
+{
+	inner_->dumpInfo( f );
+}
+
+void
+JtagDriverLayer::getCaps(Caps *caps)
+{
+	inner_->getCaps( caps );
+}
+
+void
+JtagDriverLayer::setHealthProbe(unsigned periodMs)
+{
+	inner_->setHealthProbe( periodMs );
+}
+
+bool
+JtagDriverLayer::addXferHook(JtagXferHook *hook)
+{
+	return inner_->addXferHook( hook );
+}
+
+void
+JtagDriverLayer::connDone()
+{
+	inner_->connDone();
+}
+
+static unsigned long
+nsSince(const struct timespec *then)
+{
+struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (now.tv_sec - then->tv_sec)*1000000000UL + now.tv_nsec - then->tv_nsec;
+}
+
+// min/avg/max of a series of times
+class TimeStat {
+private:
+	unsigned long n_, min_, max_;
+	double        sum_;
+
+public:
+	TimeStat()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		n_   = 0;
+		min_ = (unsigned long)-1;
+		max_ = 0;
+		sum_ = 0.0;
+	}
+
+	void add(unsigned long ns)
+	{
+		n_++;
+		sum_ += (double)ns;
+		if ( ns < min_ ) min_ = ns;
+		if ( ns > max_ ) max_ = ns;
+	}
+
+	unsigned long getN()
+	{
+		return n_;
+	}
+
+	void print(FILE *f, const char *what)
+	{
+		if ( n_ ) {
+			fprintf(f, "%s (us) min %.1f avg %.1f max %.1f\n", what, (double)min_/1000.0, sum_/(double)n_/1000.0, (double)max_/1000.0);
+		}
+	}
+};
+
+// Count shifts and messages and their timing; the numbers are
+// printed (and reset) when a client disconnects.
+class JtagDriverStats : public JtagDriverLayer, public JtagXferHook {
+private:
+	bool          hooked_;
+	unsigned long nBits_;
+	unsigned long nMsgs_, nOctets_, nTimeouts_;
+	TimeStat      shiftTime_;
+	TimeStat      rtt_;
+
+	void reset()
+	{
+		nBits_     = 0;
+		nMsgs_     = 0;
+		nOctets_   = 0;
+		nTimeouts_ = 0;
+		shiftTime_.reset();
+		rtt_.reset();
+	}
+
+public:
+	JtagDriverStats(JtagDriver *inner)
+	: JtagDriverLayer( inner                      ),
+	  hooked_        ( inner->addXferHook( this ) )
+	{
+		reset();
+	}
+
+	virtual void
+	sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+	{
+	struct timespec then;
+
+		clock_gettime( CLOCK_MONOTONIC, &then );
+		inner_->sendVectors( bits, tms, tdi, tdo );
+		shiftTime_.add( nsSince( &then ) );
+		nBits_ += bits;
+	}
+
+	virtual bool
+	xferSend(uint32_t, unsigned len)
+	{
+		nMsgs_++;
+		nOctets_ += len;
+		return true;
+	}
+
+	virtual void
+	xferDone(uint32_t, uint32_t, int got, unsigned long ns)
+	{
+		if ( got < 0 ) {
+			nTimeouts_++;
+		} else {
+			rtt_.add( ns );
+		}
+	}
+
+	void
+	dumpStats(FILE *f)
+	{
+		fprintf(f, "Layer 'stats':\n");
+		fprintf(f, "Shifts                      %ld\n", shiftTime_.getN());
+		fprintf(f, "Bits                        %ld\n", nBits_);
+		shiftTime_.print(f, "Shift Time ");
+		if ( ! hooked_ ) {
+			fprintf(f, "(no per-message statistics; not supported by driver)\n");
+			return;
+		}
+		fprintf(f, "Messages                    %ld\n", nMsgs_);
+		fprintf(f, "Message Octets Sent         %ld\n", nOctets_);
+		fprintf(f, "Timeouts                    %ld\n", nTimeouts_);
+		rtt_.print(f, "Round Trip ");
+	}
+
+	virtual void
+	dumpInfo(FILE *f)
+	{
+		JtagDriverLayer::dumpInfo( f );
+		dumpStats( f );
+	}
+
+	virtual void
+	connDone()
+	{
+		JtagDriverLayer::connDone();
+		dumpStats( stdout );
+		reset();
+	}
+};
+
+// Log every shift and message (to stderr or a file)
+class JtagDriverTrace : public JtagDriverLayer, public JtagXferHook {
+private:
+	FILE *f_;
+
+public:
+	JtagDriverTrace(JtagDriver *inner, const char *path)
+	: JtagDriverLayer( inner  ),
+	  f_             ( stderr )
+	{
+		if ( path && ! (f_ = fopen( path, "w" )) ) {
+			throw SysErr("trace layer: unable to open file");
+		}
+		inner->addXferHook( this );
+	}
+
+	virtual void
+	sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
+	{
+	struct timespec then;
+
+		clock_gettime( CLOCK_MONOTONIC, &then );
+		try {
+			inner_->sendVectors( bits, tms, tdi, tdo );
+		} catch ( std::runtime_error &e ) {
+			fprintf(f_, "trace: shift %8ld bits FAILED (%s)\n", bits, e.what());
+			throw;
+		}
+		fprintf(f_, "trace: shift %8ld bits %10.1f us\n", bits, (double)nsSince( &then )/1000.0);
+	}
+
+	virtual bool
+	xferSend(uint32_t hdr, unsigned len)
+	{
+		fprintf(f_, "trace:   send 0x%08x %6d octets\n", hdr, len);
+		return true;
+	}
+
+	virtual void
+	xferDone(uint32_t hdr, uint32_t rplHdr, int got, unsigned long ns)
+	{
+		if ( got < 0 ) {
+			fprintf(f_, "trace:   recv 0x%08x TIMEOUT    %10.1f us\n", hdr, (double)ns/1000.0);
+		} else {
+			fprintf(f_, "trace:   recv 0x%08x -> 0x%08x %6d octets %10.1f us\n", hdr, rplHdr, got, (double)ns/1000.0);
+		}
+	}
+
+	virtual void
+	connDone()
+	{
+		JtagDriverLayer::connDone();
+		fprintf(f_, "trace: connection closed\n");
+		fflush( f_ );
+	}
+
+	virtual ~JtagDriverTrace()
+	{
+		if ( f_ != stderr ) {
+			fclose( f_ );
+		}
+	}
+};
+
+// Drop every Nth message (as if lost in transit) to exercise the
+// retransmission logic. Only has an effect on a target with memory;
+// reliable transports don't retransmit.
+class JtagDriverFault : public JtagDriverLayer, public JtagXferHook {
+private:
+	unsigned long period_;
+	unsigned long count_;
+	unsigned long nDropped_;
+
+public:
+	JtagDriverFault(JtagDriver *inner, const char *arg)
+	: JtagDriverLayer( inner ),
+	  period_        ( 100   ),
+	  count_         ( 0     ),
+	  nDropped_      ( 0     )
+	{
+		if ( arg && ( 1 != sscanf( arg, "%li", &period_ ) || period_ < 2 ) ) {
+			throw std::runtime_error("fault layer: argument must be a number > 1");
+		}
+		if ( ! inner->addXferHook( this ) ) {
+			throw std::runtime_error("fault layer: not supported by driver");
+		}
+	}
+
+	virtual bool
+	xferSend(uint32_t, unsigned)
+	{
+		if ( ++count_ >= period_ ) {
+			count_ = 0;
+			nDropped_++;
+			return false;
+		}
+		return true;
+	}
+
+	virtual void
+	dumpInfo(FILE *f)
+	{
+		JtagDriverLayer::dumpInfo( f );
+		fprintf(f, "Layer 'fault':\n");
+		fprintf(f, "Drop Every Nth Message      %ld\n", period_);
+		fprintf(f, "Dropped Messages            %ld\n", nDropped_);
+	}
+};
+
+JtagDriver *
+JtagDriverLayer::stack(JtagDriver *drv, const char *layers)
+{
+std::string            l( layers ? layers : "" );
+std::string            nam, arg;
+std::string::size_type end, col;
+const char            *argp;
+
+	while ( l.size() ) {
+		if ( std::string::npos == (end = l.find( '+' )) ) {
+			end = l.size();
+		}
+		nam = l.substr( 0, end );
+		l.erase( 0, end < l.size() ? end + 1 : end );
+		if ( std::string::npos != (col = nam.find( ':' )) ) {
+			arg  = nam.substr( col + 1 );
+			nam.erase( col );
+			argp = arg.c_str();
+		} else {
+			argp = 0;
+		}
+		if ( nam == "stats" ) {
+			drv = new JtagDriverStats( drv );
+		} else if ( nam == "trace" ) {
+			drv = new JtagDriverTrace( drv, argp );
+		} else if ( nam == "fault" ) {
+			drv = new JtagDriverFault( drv, argp );
+		} else {
+			throw std::runtime_error( std::string("Unknown driver layer: '") + nam + std::string("'") );
+		}
+	}
+	return drv;
+}
+
+void
+JtagDriverLayer::usage()
+{
+	fprintf(stderr,"                   layers ('-D <driver>+<layer>[:<arg>]...'):\n");
+	fprintf(stderr,"                   'stats'        shift/message counts and timing\n");
+	fprintf(stderr,"                                  (printed when a client disconnects)\n");
+	fprintf(stderr,"                   'trace[:file]' log shifts/messages (default: stderr)\n");
+	fprintf(stderr,"                   'fault[:N]'    drop every Nth message (default: 100)\n");
+}
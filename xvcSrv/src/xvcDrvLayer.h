@@ -0,0 +1,84 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef JTAG_DRIVER_LAYER_H
+#define JTAG_DRIVER_LAYER_H
+
+#include <xvcDriver.h>
+
+// A middleware layer wraps another ('inner') driver and forwards
+// everything to it; subclasses intercept 'sendVectors()' and/or install
+// a JtagXferHook to observe (or drop) the individual messages.
+//
+// Layers are stacked on top of a transport with '-D <driver>+<layer>...',
+// e.g., '-D udp+stats+trace'. A driver without any layers is used as-is,
+// i.e., there is no overhead unless a layer is requested.
+class JtagDriverLayer : public JtagDriver {
+protected:
+	JtagDriver *inner_;
+
+public:
+	JtagDriverLayer(JtagDriver *inner);
+
+	virtual void
+	setDebug(unsigned debug);
+
+	virtual void
+	setTestMode(unsigned flags);
+
+	virtual void
+	init();
+
+	virtual unsigned long
+	query();
+
+	virtual unsigned long
+	getMaxVectorSize();
+
+	virtual uint32_t
+	setPeriodNs(uint32_t newPeriod);
+
+	virtual void
+	sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo);
+
+	virtual void
+	dumpInfo(FILE *f = stdout);
+
+	virtual void
+	getCaps(Caps *caps);
+
+	virtual void
+	setHealthProbe(unsigned periodMs);
+
+	virtual bool
+	addXferHook(JtagXferHook *hook);
+
+	virtual void
+	connDone();
+
+	// deletes the inner driver
+	virtual ~JtagDriverLayer();
+
+	// wrap 'drv' in the layers listed in 'layers' ("<name>[:<arg>]"
+	// separated by '+'; the first one is innermost). Throws
+	// std::runtime_error if a layer is unknown.
+	static JtagDriver *
+	stack(JtagDriver *drv, const char *layers);
+
+	static void usage();
+};
+
+#endif
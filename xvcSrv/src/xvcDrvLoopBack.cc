@@ -16,13 +16,37 @@
 
 #include <xvcDrvLoopBack.h>
 #include <netinet/in.h>
+#include <math.h>
+#include <xvcRle.h>
 
 JtagDriverLoopBack::JtagDriverLoopBack(int argc, char *const argv[], const char *fnam)
 : JtagDriverAxisToJtag(argc, argv   ),
+  f_      ( 0                       ),
   skip_   ( 0 == fnam || 0 == *fnam ),
   line_   ( 1                       ),
-  tdoOnly_( false                   )
+  tdoOnly_( false                   ),
+  tckDiv_ ( 9                       ),
+  maxMsg_ ( 0                       ),
+  pending_( 0                       ),
+  nSubmit_( 0                       ),
+  caps_   ( 0                       )
 {
+int opt;
+
+	while ( (opt = getopt(argc, argv, "q:")) > 0 ) {
+		switch ( opt ) {
+			case 'q':
+				if ( 1 != sscanf(optarg, "%i", &maxMsg_) ) {
+					throw std::runtime_error("Unable to scan -q <bytes> option");
+				}
+				maxMsg_ = (maxMsg_ / emulWordSize()) * emulWordSize();
+			break;
+			default:
+				fprintf( stderr,"Unknown driver option -%c\n", opt );
+				throw std::runtime_error("Unknown driver option");
+		}
+	}
+
 	if ( fnam && *fnam ) {
 		if ( ! (f_ = fopen(fnam, "r")) ) {
 			throw SysErr(fnam);
@@ -81,9 +105,61 @@ unsigned long cmp = 0;
 unsigned long
 JtagDriverLoopBack::getMaxVectorSize()
 {
+	if ( maxMsg_ ) {
+		return maxMsg_ * getWindow();
+	}
 	return 0; // allow any
 }
 
+unsigned long
+JtagDriverLoopBack::getMaxMsgVectorSize()
+{
+	return maxMsg_ ? maxMsg_ : getMaxVectorSize();
+}
+
+unsigned
+JtagDriverLoopBack::getQueueDepth()
+{
+	return maxMsg_ ? QUEUE_DEPTH : 1;
+}
+
+void
+JtagDriverLoopBack::submit( uint8_t *txb, unsigned txBytes )
+{
+const unsigned  wsz = emulWordSize();
+vector<uint8_t> *b  = &rplBuf_[ nSubmit_ % QUEUE_DEPTH ];
+
+	if ( pending_ >= QUEUE_DEPTH ) {
+		throw std::runtime_error("Internal Error: loopback queue overflow");
+	}
+	// the reply is never longer than the request (but a query reply)
+	if ( b->size() < wsz + txBytes + 4*wsz ) {
+		b->resize( wsz + txBytes + 4*wsz );
+	}
+	rplLen_[ nSubmit_ % QUEUE_DEPTH ] = xfer( txb, txBytes, &(*b)[0], wsz, &(*b)[wsz], b->size() - wsz );
+	nSubmit_++;
+	pending_++;
+}
+
+int
+JtagDriverLoopBack::complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+const unsigned  wsz = emulWordSize();
+unsigned        idx = (nSubmit_ - pending_) % QUEUE_DEPTH;
+int             got = rplLen_[ idx ];
+
+	if ( 0 == pending_ ) {
+		throw std::runtime_error("Internal Error: loopback queue empty");
+	}
+	pending_--;
+	memcpy( hdbuf, &rplBuf_[idx][0], hsize < wsz ? hsize : wsz );
+	if ( (unsigned)got > size ) {
+		got = size;
+	}
+	memcpy( rxb, &rplBuf_[idx][wsz], got );
+	return got;
+}
+
 void
 JtagDriverLoopBack::checkTDI(unsigned long val)
 {
@@ -147,6 +223,96 @@ JtagDriverLoopBack::emulMemDepth()
 	return 0; // no memory = reliable channel required!
 }
 
+unsigned
+JtagDriverLoopBack::emulNumBufs()
+{
+	return 1;
+}
+
+bool
+JtagDriverLoopBack::emulRle()
+{
+	return true;
+}
+
+bool
+JtagDriverLoopBack::emulSetTck()
+{
+	return true;
+}
+
+bool
+JtagDriverLoopBack::emulSeg()
+{
+	// no datagrams here
+	return false;
+}
+
+uint32_t
+JtagDriverLoopBack::emulPeriodNs()
+{
+	return (uint32_t)( 2.0E9/REF_FREQ_HZ() * (tckDiv_ + 1) );
+}
+
+bool
+JtagDriverLoopBack::emulClock()
+{
+	// TMS/TDI recorded in a file can't be checked
+	return ! f_ || tdoOnly_;
+}
+
+// expand a compressed shift into a plain one, execute it and
+// compress the reply if that makes it shorter.
+int
+JtagDriverLoopBack::xferRle( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+const unsigned wsz = emulWordSize();
+Header         h   = getHdr( txb );
+unsigned long  bytes, wbytes, i;
+unsigned       hsz;
+long           l1, l2;
+int            got, zlen, elen;
+
+	bytes  = (getMsgLen( txb, wsz, &hsz ) + 7)/8;
+	wbytes = ((bytes + wsz - 1)/wsz)*wsz;
+
+	rleTx_.resize( hsz + 2*wbytes );
+	rleRx_.resize( 2*wbytes + wsz );
+
+	// decode TMS and TDI and interleave them
+	if (    txBytes < hsz
+	     || (l1 = rleDecode( &rleRx_[0],      bytes, txb + hsz,      txBytes - hsz      )) < 0
+	     || (l2 = rleDecode( &rleRx_[wbytes], bytes, txb + hsz + l1, txBytes - hsz - l1 )) < 0 ) {
+		h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | ERR_TRUNCATED);
+		setw32( hdbuf, h );
+		return 0;
+	}
+	memset( &rleRx_[bytes],          0, wbytes - bytes );
+	memset( &rleRx_[wbytes + bytes], 0, wbytes - bytes );
+
+	// same header (short or long) but a plain shift
+	memcpy( &rleTx_[0], txb, hsz );
+	setw32( &rleTx_[0], (h & ~CMD_MASK) | CMD_S );
+	for ( i = 0; i < wbytes; i += wsz ) {
+		memcpy( &rleTx_[hsz + 2*i      ], &rleRx_[i         ], wsz );
+		memcpy( &rleTx_[hsz + 2*i + wsz], &rleRx_[wbytes + i], wsz );
+	}
+
+	got = JtagDriverLoopBack::xfer( &rleTx_[0], rleTx_.size(), hdbuf, hsize, rxb, size );
+
+	if ( getCmd( getHdr( hdbuf ) ) == CMD_S && got > 0 ) {
+		elen = rleEncode( &rleRx_[0], got, rxb, got );
+		zlen = ((elen + wsz - 1)/wsz)*wsz;
+		if ( elen > 0 && zlen < got ) {
+			memset( &rleRx_[elen], 0, zlen - elen );
+			memcpy( rxb, &rleRx_[0], zlen );
+			setw32( hdbuf, (getHdr( hdbuf ) & ~CMD_MASK) | CMD_Z );
+			got = zlen;
+		}
+	}
+	return got;
+}
+
 
 int
 JtagDriverLoopBack::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
@@ -158,8 +324,10 @@ unsigned long  bits;
 unsigned       bytes;
 unsigned       rem;
 unsigned       wbytes;
+unsigned       hsz;
+uint32_t       per;
 const unsigned wsz = emulWordSize();
-const unsigned dpt = emulMemDepth();
+unsigned       dpt;
 char           cbuf[1024];
 
 	if ( txBytes < 4 )
@@ -168,12 +336,47 @@ char           cbuf[1024];
 	i = 0;
 	uint32_t h = (((((txb[i+3]<<8)|txb[i+2])<<8)|txb[i+1])<<8)|txb[i+0];
 
-	if ( getVrs(h) != PVER0 ) {
-		h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | 2 );
+	if ( getVrs(h) != PVER0 && getVrs(h) != PVER1 && getVrs(h) != PVER2 ) {
+		// reply with the supported version
+		h = (h & ~(VRS_MASK | CMD_MASK | LEN_MASK)) | (PVERS | CMD_E | ERR_BAD_VERSION );
 	} else {
 		switch ( (cmd = getCmd( h )) ) {
 			case CMD_Q:
-				h |= ((dpt & 0xfffff) << 4 ) | (wsz-1);
+				caps_ = 0;
+				if ( getVrs(h) != PVER0 && size >= wsz ) {
+					caps_ = (emulRle() ? CAP_RLE : 0) | (emulClock() ? CAP_CLOCK : 0);
+					if ( getVrs(h) == PVER2 ) {
+						caps_ |= (emulSetTck() ? CAP_SETTCK : 0) | (emulSeg() ? CAP_SEG : 0);
+						// only what the client supports, too
+						// (in the two words following the header)
+						caps_ &= ( txBytes >= 2*wsz ? getw32( txb + wsz ) : 0 );
+						if ( (caps_ & CAP_SETTCK) && txBytes >= 3*wsz && (per = getw32( txb + 2*wsz )) ) {
+							// fastest TCK not faster than requested
+							tckDiv_ = (unsigned)ceil( (double)per * REF_FREQ_HZ()/2.0E9 ) - 1;
+							if ( tckDiv_ > 0xffff ) {
+								tckDiv_ = 0xffff;
+							}
+							if ( getDebug() > 1 ) {
+								fprintf(stderr, "SETTCK %ldns -> %ldns\n", (unsigned long)per, (unsigned long)emulPeriodNs());
+							}
+						}
+					}
+				}
+				// may depend on the capabilities
+				dpt = emulMemDepth();
+				if ( getVrs(h) != PVER0 && size >= wsz ) {
+					setValLE( emulNumBufs() | caps_, rxb, wsz );
+					rval = wsz;
+					if ( getVrs(h) == PVER2 && size >= 3*wsz ) {
+						setValLE( dpt,            rxb +   wsz, wsz );
+						setValLE( emulPeriodNs(), rxb + 2*wsz, wsz );
+						rval = 3*wsz;
+					}
+				}
+				if ( (per = encPerNs( emulPeriodNs() )) > 0xff ) {
+					per = 0xff;
+				}
+				h |= (per << XID_SHIFT) | ((dpt & 0xfffff) << 4 ) | (wsz-1);
 				if ( getDebug() > 1 ) {
 					fprintf(stderr, "QUERY \n");
 				}
@@ -187,32 +390,32 @@ char           cbuf[1024];
 				if ( getDebug() > 1 ) {
 					fprintf(stderr, "SHIFT\n");
 				}
-				bits = getLen( h );
+				bits = getMsgLen( txb, wsz, &hsz );
 
 				checkLEN( bits );
 
 				bytes  = (bits + 7 )/8;
 				wbytes = (bytes/wsz)*wsz;
-				if ( txBytes < wsz + 2*bytes ) {
+				if ( txBytes < hsz + 2*bytes ) {
 					fprintf(stderr,"txBytes: %d, word-size %d, vector-size %d\n", txBytes, wsz, bytes);
 					throw std::runtime_error("Not enough TX bytes??");
 				}
 
 				for ( j = i = 0; i < 2*wbytes; i += 2*wsz, j += wsz ) {
-					checkTMS( getValLE( &txb[wsz       + i], wsz ) );
-					checkTDI( getValLE( &txb[wsz + wsz + i], wsz ) );
+					checkTMS( getValLE( &txb[hsz       + i], wsz ) );
+					checkTDI( getValLE( &txb[hsz + wsz + i], wsz ) );
 					if ( skip_ ) {
 						// loop TDI back
-						memcpy( &rxb[j], &txb[wsz + wsz + i], wsz );
+						memcpy( &rxb[j], &txb[hsz + wsz + i], wsz );
 					}
 				}
 
 				if ( (rem = (bytes - wbytes)) ) {
-					checkTMS( getValLE( &txb[wsz       + i], rem ) );
-					checkTDI( getValLE( &txb[wsz + wsz + i], rem ) );
+					checkTMS( getValLE( &txb[hsz       + i], rem ) );
+					checkTDI( getValLE( &txb[hsz + wsz + i], rem ) );
 					if ( skip_ ) {
 						// loop TDI back
-						memcpy( &rxb[j], &txb[wsz + wsz + i], rem );
+						memcpy( &rxb[j], &txb[hsz + wsz + i], rem );
 					}
 				}
 
@@ -228,6 +431,34 @@ char           cbuf[1024];
 				rval = bytes;
 				break;
 
+			case CMD_Z:
+				if ( getVrs(h) != PVER0 && (caps_ & CAP_RLE) ) {
+					return xferRle( txb, txBytes, hdbuf, hsize, rxb, size );
+				}
+				h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | 1 );
+				break;
+
+			case CMD_C:
+				if ( getVrs(h) != PVER0 && (caps_ & CAP_CLOCK) ) {
+					bits = getMsgLen( txb, wsz, &hsz );
+					if ( txBytes < hsz + wsz ) {
+						throw std::runtime_error("Not enough TX bytes??");
+					}
+					if ( getDebug() > 1 ) {
+						fprintf(stderr, "CLOCK %ld (TMS %d, TDI %d)\n", bits, txb[hsz] & 1, (txb[hsz] >> 1) & 1);
+					}
+					// the TDO vector was recorded but is not wanted
+					if ( ! skip_ ) {
+						bytes = (bits + 7)/8;
+						for ( i = 0; i < bytes; i += wsz ) {
+							getTDO();
+						}
+					}
+					h = (h & ~(CMD_MASK | LEN_MASK)) | CMD_C | CLK_ACK;
+					rval = 0;
+					break;
+				}
+				/* fall through */
 			default:
 				h = (h & ~(CMD_MASK | LEN_MASK)) | (CMD_E | 1 );
 				break;
@@ -240,14 +471,31 @@ char           cbuf[1024];
 
 UdpLoopBack::UdpLoopBack(const char *fnam, unsigned port)
 : JtagDriverLoopBack( 0, 0, fnam ),
-  sock_( false      ),
-  tsiz_( -1         )
+  sock_  ( false      ),
+  nExec_ ( 0          ),
+  nxtXid_( 0          ),
+  synced_( false      )
 {
 struct sockaddr_in a;
 int               yes = 1;
+unsigned          i;
+
+	// any datagram (the client's MTU on 'lo' is large); a reply
+	// to a segmented message may be as large as the memory
+	rbuf_.reserve(65536);
+	tbuf_.reserve(2*SEG_MEM_DEPTH*emulWordSize() + 1500);
+
+	slots_.resize( emulNumBufs() );
+	for ( i = 0; i < slots_.size(); i++ ) {
+		slots_[i].valid_ = false;
+		slots_[i].frame_ = 0;
+		slots_[i].data_.resize( 1500 );
+	}
 
-	rbuf_.reserve(1500);
-	tbuf_.reserve(1500);
+	asm_.resize( 256 );
+	for ( i = 0; i < asm_.size(); i++ ) {
+		clrAsm( &asm_[i] );
+	}
 
 	a.sin_family      = AF_INET;
 	a.sin_addr.s_addr = INADDR_ANY;
@@ -271,26 +519,48 @@ UdpLoopBack::~UdpLoopBack()
 int
 UdpLoopBack::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
 {
-Header txh = getHdr( txb   );
-Header rxh = getHdr( hdbuf );
-
-int    got;
-bool   isNewShift = false;
+Header   txh  = getHdr( txb );
+Xid      xid  = getXid( txh );
+// version 0 has a single replay buffer
+unsigned nb   = getVrs( txh ) != PVER0 ? slots_.size() : 1;
+unsigned i;
+int      got;
+bool     isNewShift = false;
+Slot    *s;
 
 	switch ( getCmd(txh) ) {
 		case CMD_Q:
 			// assume a new connection
-			tsiz_ = -1;
+			for ( i = 0; i < slots_.size(); i++ ) {
+				slots_[i].valid_ = false;
+			}
+			for ( i = 0; i < asm_.size(); i++ ) {
+				clrAsm( &asm_[i] );
+			}
+			synced_ = false;
 			break;
 
 		case CMD_S:
-			if ( getXid( txh ) == getXid( rxh ) ) {
-				// retry!
-				if ( tsiz_ < 0 ) {
-					throw std::runtime_error("ERROR: UdpLoopBack - attempted retry but have no valid message!");
+		case CMD_Z:
+		case CMD_C:
+			for ( i = 0; i < nb; i++ ) {
+				s = &slots_[i];
+				if ( s->valid_ && s->xid_ == xid ) {
+					// retry; play back
+					if ( (unsigned)s->len_ > size ) {
+						throw std::runtime_error("ERROR: UdpLoopBack - replay buffer too small");
+					}
+					setw32( hdbuf, s->hdr_ );
+					memcpy( rxb, &s->data_[0], s->len_ );
+					return s->len_;
+				}
+			}
+			if ( PVER0 != getVrs( txh ) && synced_ && xid != nxtXid_ ) {
+				// out of sequence; a predecessor was lost
+				if ( getDebug() > 1 ) {
+					fprintf(stderr, "UdpLoopBack: dropping XID %d (expected %d)\n", xid, nxtXid_);
 				}
-				// resend what we have
-				return tsiz_;
+				return -1;
 			}
 			isNewShift = true;
 			break;
@@ -302,19 +572,239 @@ bool   isNewShift = false;
 	got = JtagDriverLoopBack::xfer( txb, txBytes, hdbuf, hsize, rxb, size );
 
 	if ( isNewShift ) {
-		tsiz_ = got;
+		s = &slots_[ nExec_++ % nb ];
+		if ( (unsigned)got > s->data_.size() ) {
+			s->data_.resize( got );
+		}
+		s->valid_ = true;
+		s->xid_   = xid;
+		s->hdr_   = getHdr( hdbuf );
+		s->len_   = got;
+		s->frame_ = 0;
+		memcpy( &s->data_[0], rxb, got );
+		nxtXid_   = xid + 1;
+		synced_   = true;
 	}
 
 	return got;
 }
 
+unsigned
+UdpLoopBack::emulNumBufs()
+{
+	return 16;
+}
+
+void
+UdpLoopBack::setBusyPoll(unsigned us)
+{
+	sock_.setBusyPoll( us );
+}
+
+bool
+UdpLoopBack::emulSeg()
+{
+	return true;
+}
+
 unsigned
 UdpLoopBack::emulMemDepth()
 {
+	if ( caps_ & CAP_SEG ) {
+		return SEG_MEM_DEPTH;
+	}
 	// limit to ethernet MTU; 2 vectors plus header must fit...
 	return 1450/2/emulWordSize() - 1;
 }
 
+void
+UdpLoopBack::clrAsm(Asm *a)
+{
+	a->have_  = 0;
+	a->nSegs_ = 0;
+	a->len_   = 0;
+	a->frame_ = 0;
+	a->frag_  = 0;
+	memset( a->map_, 0, sizeof(a->map_) );
+}
+
+UdpLoopBack::Slot *
+UdpLoopBack::findSlot(Xid xid)
+{
+unsigned i;
+
+	for ( i = 0; i < slots_.size(); i++ ) {
+		if ( slots_[i].valid_ && slots_[i].xid_ == xid ) {
+			return &slots_[i];
+		}
+	}
+	return 0;
+}
+
+void
+UdpLoopBack::sendv(struct iovec *iov, unsigned iovcnt, struct sockaddr *sa, socklen_t sl)
+{
+struct msghdr m;
+
+	memset( &m, 0, sizeof(m) );
+	m.msg_name    = sa;
+	m.msg_namelen = sl;
+	m.msg_iov     = iov;
+	m.msg_iovlen  = iovcnt;
+	if ( sendmsg( sock_.getSd(), &m, 0 ) < 0 ) {
+		throw SysErr("UdpLoopBack: unable to send from socket");
+	}
+}
+
+void
+UdpLoopBack::sendReply(Header hdr, uint8_t *pld, int len, unsigned frame, const uint8_t *have, struct sockaddr *sa, socklen_t sl)
+{
+const unsigned wsz = emulWordSize();
+unsigned       tot = wsz + len;
+unsigned       frag, num, off;
+uint8_t        fhdr[SEG_HSIZE];
+struct iovec   iov[2];
+
+	if ( ! frame || tot <= frame ) {
+		setw32( fhdr, hdr );
+		iov[0].iov_base = fhdr;
+		iov[0].iov_len  = wsz;
+		iov[1].iov_base = pld;
+		iov[1].iov_len  = len;
+		sendv( iov, 2, sa, sl );
+		return;
+	}
+
+	// header and payload in one piece
+	if ( fbuf_.size() < tot ) {
+		fbuf_.resize( tot );
+	}
+	setw32( &fbuf_[0], hdr );
+	memcpy( &fbuf_[wsz], pld, len );
+
+	frag = ((frame - SEG_HSIZE)/wsz)*wsz;
+	for ( num = 0, off = 0; off < tot; num++, off += frag ) {
+		if ( have && (have[num/8] & (1 << (num % 8))) ) {
+			continue;
+		}
+		setw32( fhdr,                  mkSegHdr( getXid( hdr ), num, off + frag >= tot ? SEG_LAST : 0 ) );
+		setw32( fhdr + sizeof(Header), off );
+		iov[0].iov_base = fhdr;
+		iov[0].iov_len  = SEG_HSIZE;
+		iov[1].iov_base = &fbuf_[off];
+		iov[1].iov_len  = off + frag >= tot ? tot - off : frag;
+		sendv( iov, 2, sa, sl );
+	}
+}
+
+void
+UdpLoopBack::sendStatus(Xid xid, const uint8_t *map, struct sockaddr *sa, socklen_t sl)
+{
+uint8_t        fhdr[SEG_HSIZE];
+struct iovec   iov[2];
+
+	setw32( fhdr,                  mkSegHdr( xid, 0, SEG_STATUS ) );
+	setw32( fhdr + sizeof(Header), 0 );
+	iov[0].iov_base = fhdr;
+	iov[0].iov_len  = SEG_HSIZE;
+	iov[1].iov_base = (void*)map;
+	iov[1].iov_len  = MAX_SEGS/8;
+	sendv( iov, 2, sa, sl );
+}
+
+void
+UdpLoopBack::rcvFrame(uint8_t *buf, unsigned len, struct sockaddr *sa, socklen_t sl)
+{
+const unsigned wsz = emulWordSize();
+Header         h   = getHdr( buf );
+Xid            xid = getSegXid( h );
+unsigned       num = getSegNum( h );
+Asm           *a   = &asm_[xid];
+Slot          *s   = findSlot( xid );
+unsigned       off, frag;
+
+	if ( len < SEG_HSIZE ) {
+		throw ProtoErr("UdpLoopBack: truncated segment frame");
+	}
+
+	if ( (h & SEG_STATUS) ) {
+		if ( len < SEG_HSIZE + MAX_SEGS/8 ) {
+			throw ProtoErr("UdpLoopBack: truncated status frame");
+		}
+		// the client lacks (parts of) the reply or we lack
+		// parts of the message
+		if ( s ) {
+			sendReply( s->hdr_, &s->data_[0], s->len_, s->frame_, buf + SEG_HSIZE, sa, sl );
+		} else {
+			sendStatus( xid, a->map_, sa, sl );
+		}
+		return;
+	}
+
+	// executed already or stale
+	if ( s || ( synced_ && (Xid)(xid - nxtXid_) >= slots_.size() ) ) {
+		return;
+	}
+
+	off  = getw32( buf + sizeof(Header) );
+	len -= SEG_HSIZE;
+	if ( off + len > 2*(SEG_MEM_DEPTH + 1)*wsz ) {
+		throw ProtoErr("UdpLoopBack: segmented message too long");
+	}
+	// if the client starts over with smaller frames (its path MTU
+	// dropped) then the frame numbers change; drop what we have
+	frag = num ? off/num : ( (h & SEG_LAST) ? 0 : len );
+	if ( frag && a->frag_ && frag != a->frag_ ) {
+		clrAsm( a );
+	}
+	if ( frag ) {
+		a->frag_ = frag;
+	}
+	if ( a->buf_.size() < off + len ) {
+		a->buf_.resize( off + len );
+	}
+	memcpy( &a->buf_[off], buf + SEG_HSIZE, len );
+	if ( len + SEG_HSIZE > a->frame_ ) {
+		a->frame_ = len + SEG_HSIZE;
+	}
+	if ( ! (a->map_[num/8] & (1 << (num % 8))) ) {
+		a->map_[num/8] |= (1 << (num % 8));
+		a->have_++;
+	}
+	if ( (h & SEG_LAST) ) {
+		a->nSegs_ = num + 1;
+		a->len_   = off + len;
+		if ( a->have_ < a->nSegs_ ) {
+			// frames were lost; don't wait for the client to time out
+			sendStatus( xid, a->map_, sa, sl );
+		}
+	}
+
+	runAsm( xid, sa, sl );
+}
+
+void
+UdpLoopBack::runAsm(Xid xid, struct sockaddr *sa, socklen_t sl)
+{
+Asm  *a;
+Slot *s;
+int   pld;
+
+	while ( (a = &asm_[xid])->nSegs_ && a->have_ == a->nSegs_ ) {
+		pld = xfer( &a->buf_[0], a->len_, &tbuf_[0], 4, &tbuf_[4], tbuf_.capacity() - 4 );
+		if ( pld < 0 ) {
+			// a predecessor is missing; keep it
+			break;
+		}
+		if ( (s = findSlot( xid )) ) {
+			s->frame_ = a->frame_;
+		}
+		sendReply( getHdr( &tbuf_[0] ), &tbuf_[4], pld, a->frame_, 0, sa, sl );
+		clrAsm( a );
+		xid = nxtXid_;
+	}
+}
+
 void
 UdpLoopBack::run()
 {
@@ -330,15 +820,42 @@ socklen_t        sl;
 		if ( got < 4 ) {
 			throw ProtoErr("UdpLoopBack: got no header!");
 		}
+		if ( (unsigned)got > MAX_DATAGRAM ) {
+			// doesn't fit into our buffer
+			if ( getDebug() > 1 ) {
+				fprintf(stderr, "UdpLoopBack: dropping datagram of %d octets\n", got);
+			}
+			continue;
+		}
 		if ( drEn_ && ( (++drop_ & 0xff) == 0 ) ) {
 			fprintf(stderr, "Drop\n");
 			continue;
 		}
+		if ( isSegFrame( getHdr( &rbuf_[0] ) ) && (caps_ & CAP_SEG) ) {
+			rcvFrame( &rbuf_[0], got, &sa, sl );
+			continue;
+		}
 		pld = xfer( &rbuf_[0], got, &tbuf_[0], 4, &tbuf_[4], tbuf_.capacity() - 4 );
+		if ( pld < 0 ) {
+			// no reply
+			continue;
+		}
 		if ( sendto( sock_.getSd(), &tbuf_[0], pld + 4, 0, &sa, sl ) < 0 ) {
 			throw SysErr("UdpLoopBack: unable to send from socket");
 		}
+		if ( (caps_ & CAP_SEG) ) {
+			// a segmented successor may be waiting for this one
+			runAsm( nxtXid_, &sa, sl );
+		}
 	}
 }
 
+void
+JtagDriverLoopBack::usage()
+{
+	printf("  Loopback Driver options: [-q <bytes>]\n");
+	printf("  -q <bytes>  : queue messages of at most <bytes> (vector length)\n");
+	printf("                like a reliable transport (zynqAxis, tmem) does\n");
+}
+
 static DriverRegistrar<JtagDriverLoopBack> r("loopback");
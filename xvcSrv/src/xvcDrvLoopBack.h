@@ -36,6 +36,26 @@ private:
     bool          skip_;
 	bool          tdoOnly_;
 	unsigned long line_;
+	// emulated TCK divider
+	unsigned      tckDiv_;
+	// decoded compressed requests/encoded replies
+	vector<uint8_t> rleTx_;
+	vector<uint8_t> rleRx_;
+	// emulate a reliable transport which queues messages
+	// (max. vector of a message; 0: no queueing)
+	static const unsigned QUEUE_DEPTH = 2;
+	unsigned        maxMsg_;
+	unsigned        pending_;
+	unsigned        nSubmit_;
+	vector<uint8_t> rplBuf_[QUEUE_DEPTH];
+	int             rplLen_[QUEUE_DEPTH];
+
+	int xferRle( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+protected:
+	// capabilities shared with the client (protocol version 1 and up)
+	uint32_t      caps_;
+
 public:
 
 	JtagDriverLoopBack(int argc, char *const argv[], const char *fnam = 0);
@@ -44,6 +64,18 @@ public:
 
 	virtual unsigned emulWordSize();
 	virtual unsigned emulMemDepth();
+	// reply buffers advertised to a protocol version 1 client
+	virtual unsigned emulNumBufs();
+	// compressed shifts advertised to a protocol version 1 (or 2) client
+	virtual bool     emulRle();
+	// clock commands advertised to a protocol version 1 client
+	virtual bool     emulClock();
+	// TCK period setting advertised to a protocol version 2 client
+	virtual bool     emulSetTck();
+	// segmented messages advertised to a protocol version 2 client
+	virtual bool     emulSeg();
+	// TCK period for the current divider (REF_FREQ_HZ()/2/(tckDiv_ + 1))
+	virtual uint32_t emulPeriodNs();
 
 	virtual bool rdl(char *buf, size_t bufsz);
 
@@ -64,18 +96,89 @@ public:
 	virtual unsigned long
 	getMaxVectorSize();
 
+	virtual unsigned long
+	getMaxMsgVectorSize();
+
+	virtual unsigned
+	getQueueDepth();
+
+	// 'submit()' executes the message and stores the reply
+	// which 'complete()' hands out.
+	virtual void
+	submit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
 	// main transfer method
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	static void usage();
 };
 
-// mimick the 'far' end of UDP, i.e., a FW server
+// mimick the 'far' end of UDP, i.e., a FW server (including
+// the replay memory: a single buffer for protocol version 0,
+// 'emulNumBufs()' buffers for version 1).
+// A client which supports segmented messages (version 2) is offered
+// a memory of SEG_MEM_DEPTH words; without them a message must fit
+// into an ethernet frame and the memory is limited accordingly.
+// Like firmware with a jumbo-frame buffer it drops datagrams longer
+// than MAX_DATAGRAM (which path MTU probing of the client must find).
 class UdpLoopBack : public JtagDriverLoopBack {
 private:
+	typedef struct {
+		bool            valid_;
+		Xid             xid_;
+		Header          hdr_;
+		int             len_;
+		vector<uint8_t> data_;
+		// largest frame of a segmented message (0: plain)
+		unsigned        frame_;
+	} Slot;
+
+	// reassembly of a segmented message
+	typedef struct {
+		unsigned        have_;
+		// number of frames (0 until the last one arrived)
+		unsigned        nSegs_;
+		unsigned        len_;
+		unsigned        frame_;
+		// piece size of all but the last frame
+		unsigned        frag_;
+		uint8_t         map_[MAX_SEGS/8];
+		vector<uint8_t> buf_;
+	} Asm;
+
+	static const unsigned SEG_MEM_DEPTH = 4096;
+	static const unsigned MAX_DATAGRAM  = 9000 - 28;
+
 	SockSd            sock_;
 	vector<uint8_t>   rbuf_;
 	vector<uint8_t>   tbuf_;
-	int               tsiz_;
+	vector<Slot>      slots_;
+	// number of executed shifts and next XID expected (version 1)
+	unsigned long     nExec_;
+	Xid               nxtXid_;
+	bool              synced_;
+	// reassembly per XID
+	vector<Asm>       asm_;
+	vector<uint8_t>   fbuf_;
+
+	void   clrAsm(Asm *a);
+	Slot  *findSlot(Xid xid);
+	void   sendv(struct iovec *iov, unsigned iovcnt, struct sockaddr *sa, socklen_t sl);
+	// send a reply; the reply to a segmented message is split into
+	// frames no larger than 'frame' (the largest one of the message)
+	// unless it fits into one. Frames set in the bitmap 'have' (if
+	// any) are skipped.
+	void   sendReply(Header hdr, uint8_t *pld, int len, unsigned frame, const uint8_t *have, struct sockaddr *sa, socklen_t sl);
+	void   sendStatus(Xid xid, const uint8_t *map, struct sockaddr *sa, socklen_t sl);
+	// handle a segment frame
+	void   rcvFrame(uint8_t *buf, unsigned len, struct sockaddr *sa, socklen_t sl);
+	// execute the reassembled message 'xid' and its successors
+	// (as long as they are complete and next in sequence)
+	void   runAsm(Xid xid, struct sockaddr *sa, socklen_t sl);
 
 public:
 	UdpLoopBack( const char *fnam, unsigned port = 2543 );
@@ -86,8 +189,16 @@ public:
 	virtual unsigned
 	emulMemDepth();
 
+	virtual unsigned
+	emulNumBufs();
+
+	virtual bool
+	emulSeg();
+
 	void run();
 
+	virtual void setBusyPoll(unsigned us);
+
 	virtual ~UdpLoopBack();
 };
 
@@ -18,17 +18,82 @@
 #include <netdb.h>
 #include <string.h>
 #include <netinet/ip.h>
+#include <netinet/udp.h>
 #include <sys/uio.h>
+#include <math.h>
+#include <signal.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 
 static const char *DFLT_PORT="2542";
 
 static const unsigned MAXL  = 256;
 
+static const unsigned DFLT_RTO_MIN_US =    500;
+static const unsigned DFLT_RTO_MAX_US = 500000;
+static const unsigned DFLT_RETRIES    =     12;
+
+// IP_MTU includes the IPv4 and UDP headers
+static const unsigned IP_UDP_HDR      =     28;
+static const unsigned MAX_UDP_PLD     =  65507;
+// the kernel sends at most this many GSO segments per datagram
+// and coalesces (GRO) into at most 64KiB
+static const unsigned MAX_GSO_SEGS    =     64;
+static const unsigned MAX_GRO_PLD     =  65536;
+// every IPv4 path takes 576 octets
+static const unsigned MIN_UDP_PLD     =    576 - IP_UDP_HDR;
+static const unsigned PMTU_TRIES      =      2;
+
+// drivers with kernel timestamps (-T); a thread prints their
+// histograms when SIGUSR1 arrives
+static pthread_mutex_t        tsDrvMtx = PTHREAD_MUTEX_INITIALIZER;
+static vector<JtagDriverUdp*> tsDrvs;
+
 JtagDriverUdp::JtagDriverUdp(int argc, char *const argv[], const char *target)
 : JtagDriverAxisToJtag( argc, argv ),
   sock_      ( false ),
-  timeoutMs_ ( 500   ),
-  mtu_       ( 1450  ) // ethernet mtu minus MAC/IP/UDP addresses
+  rtoUs_      ( DFLT_RTO_MAX_US ),
+  rtoMinUs_   ( DFLT_RTO_MIN_US ),
+  rtoMaxUs_   ( DFLT_RTO_MAX_US ),
+  rttValid_   ( false ),
+  srttUs_     ( 0.0   ),
+  rttvarUs_   ( 0.0   ),
+  nRttSamples_( 0     ),
+  nTimeouts_  ( 0     ),
+  execUs_     ( 0     ),
+  nOut_       ( 0     ),
+  qryOut_     ( false ),
+  rcvdXid_    ( 0     ),
+  nStale_     ( 0     ),
+  nDups_      ( 0     ),
+  nReord_     ( 0     ),
+  mtu_       ( 1450  ), // ethernet mtu minus MAC/IP/UDP addresses
+  pmtuEna_   ( true  ),
+  mtuMax_    ( MAX_UDP_PLD ),
+  nPmtuProbes_( 0    ),
+  nPmtuDrops_( 0     ),
+  spinUs_    ( 0     ),
+  sg_        ( false ),
+  segEna_    ( true  ),
+  nSegMsgs_  ( 0     ),
+  nSegResent_( 0     ),
+  batch_     ( false ),
+  gso_       ( false ),
+  gro_       ( false ),
+  nTx_       ( 0     ),
+  rxSlotSz_  ( 0     ),
+  rxHead_    ( 0     ),
+  tsReq_     ( false ),
+  tsEna_     ( false ),
+  tsTxOk_    ( false ),
+  tsRxOk_    ( false ),
+  nTsXfers_  ( 0     ),
+  nTsMissed_ ( 0     ),
+  nTxCalls_  ( 0     ),
+  nTxMsgs_   ( 0     ),
+  nRxCalls_  ( 0     ),
+  nRxMsgs_   ( 0     ),
+  nPolls_    ( 0     )
 {
 struct addrinfo hint, *res;
 const char            *col, *prtnam;
@@ -40,8 +105,20 @@ unsigned              *i_p;
 socklen_t              slen;
 bool                   userMtu = false;
 bool                   frag    = false;
+unsigned               busyUs  = 0;
+unsigned               window;
+unsigned               retries = DFLT_RETRIES;
+unsigned               clkRun;
+unsigned               vers;
+sigset_t               sigs;
+pthread_t              tid;
+
+	pthread_mutex_init( &tsMtx_, 0 );
+	tsWire_.reset();
+	tsSend_.reset();
+	tsRecv_.reset();
 
-	while ( (opt = getopt(argc, argv, "m:f")) > 0 ) {
+	while ( (opt = getopt(argc, argv, "m:fb:s:w:gr:R:n:Zk:P:MGXdT")) > 0 ) {
 
 		i_p = 0;
 
@@ -55,6 +132,66 @@ bool                   frag    = false;
 				frag    = true;
 			break;
 
+			case 'b':
+				i_p     = &busyUs;
+			break;
+
+			case 's':
+				i_p     = &spinUs_;
+			break;
+
+			case 'w':
+				i_p     = &window;
+			break;
+
+			case 'g':
+				sg_     = true;
+			break;
+
+			case 'r':
+				i_p     = &rtoMinUs_;
+			break;
+
+			case 'R':
+				i_p     = &rtoMaxUs_;
+			break;
+
+			case 'n':
+				i_p     = &retries;
+			break;
+
+			case 'Z':
+				setCompression( false );
+			break;
+
+			case 'k':
+				i_p     = &clkRun;
+			break;
+
+			case 'P':
+				i_p     = &vers;
+			break;
+
+			case 'G':
+				gso_    = true;
+				gro_    = true;
+				/* fall through */
+			case 'M':
+				batch_  = true;
+			break;
+
+			case 'X':
+				segEna_ = false;
+			break;
+
+			case 'd':
+				pmtuEna_ = false;
+			break;
+
+			case 'T':
+				tsReq_  = true;
+			break;
+
 			default:
 				fprintf(stderr,"Unknown driver option -%c\n", opt);
 				throw std::runtime_error("Unknown driver option");
@@ -65,9 +202,37 @@ bool                   frag    = false;
 				fprintf(stderr,"Unable to scan argument to option -%c\n", opt);
 				throw std::runtime_error("Unable to scan option argument");
 			}
+			if ( &window == i_p ) {
+				setMaxWindow( window );
+			}
+			if ( &clkRun == i_p ) {
+				setClockRun( clkRun );
+			}
+			if ( &vers == i_p ) {
+				setMaxVersion( vers );
+			}
 		}
 	}
 
+	if ( userMtu ) {
+		// probing doesn't go beyond
+		mtuMax_ = mtu_;
+	}
+
+	if ( 0 == rtoMinUs_ || rtoMinUs_ > rtoMaxUs_ ) {
+		throw std::runtime_error("Invalid retransmission timeout limits (need 0 < min <= max)");
+	}
+	// conservative until we have a sample
+	rtoUs_ = rtoMaxUs_;
+
+	if ( tsReq_ && batch_ ) {
+		throw std::runtime_error("Kernel timestamps (-T) cannot be combined with batching (-M, -G)");
+	}
+
+	setMaxRetries( retries );
+
+	memset( txRecs_, 0, sizeof(txRecs_) );
+
 	if ( (col = strchr(target, ':')) ) {
 
 		l = col - target;
@@ -111,6 +276,7 @@ bool                   frag    = false;
 	if ( stat ) {
 		fprintf(stderr,"Warning: Unable to estimate MTU (getsockopt(IP_MTU) failed: %s) -- using %d\n", strerror(errno), mtu_);
 	} else {
+		mtu = mtu > MAX_UDP_PLD + IP_UDP_HDR ? MAX_UDP_PLD : mtu - IP_UDP_HDR;
 		if ( mtu < mtu_ ) {
 			fprintf(stderr,"Warning: requested MTU limit (%d) > IP_MTU; clipping to %d octets\n", mtu_, mtu);
 			mtu_ = mtu;
@@ -128,98 +294,1326 @@ bool                   frag    = false;
 		}
 	}
 
+	if ( busyUs ) {
+		sock_.setBusyPoll( busyUs );
+	}
+
+#ifdef UDP_GRO
+	opt = 1;
+	if ( gro_ && setsockopt( sock_.getSd(), IPPROTO_UDP, UDP_GRO, &opt, sizeof(opt) ) ) {
+		fprintf(stderr,"Warning: Unable to enable UDP_GRO (%s) -- receiving datagrams individually\n", strerror(errno));
+		gro_ = false;
+	}
+#else
+	if ( gso_ ) {
+		fprintf(stderr,"Warning: UDP GSO/GRO not supported by this build -- using sendmmsg/recvmmsg\n");
+		gso_ = false;
+		gro_ = false;
+	}
+#endif
+
 	poll_[0].fd     = sock_.getSd();
 	poll_[0].events = POLLIN;
+
+	if ( tsReq_ ) {
+		// blocked before any other thread is created; only
+		// the dump thread takes it
+		sigemptyset( &sigs );
+		sigaddset( &sigs, SIGUSR1 );
+		pthread_sigmask( SIG_BLOCK, &sigs, 0 );
+
+		MtxLock lck( &tsDrvMtx );
+		if ( tsDrvs.empty() ) {
+			if ( pthread_create( &tid, 0, tsThread, 0 ) ) {
+				throw SysErr("Unable to launch timestamp dump thread");
+			}
+			pthread_detach( tid );
+		}
+		tsDrvs.push_back( this );
+	}
 }
 
 JtagDriverUdp::~JtagDriverUdp()
 {
+unsigned i;
+
+	{
+	MtxLock lck( &tsDrvMtx );
+		for ( i = 0; i < tsDrvs.size(); i++ ) {
+			if ( this == tsDrvs[i] ) {
+				tsDrvs.erase( tsDrvs.begin() + i );
+				break;
+			}
+		}
+	}
+	pthread_mutex_destroy( &tsMtx_ );
 }
 
 
 void
 JtagDriverUdp::init()
 {
+int opt;
+
 	JtagDriverAxisToJtag::init();
 	if ( getMemDepth() == 0 ) {
 		fprintf(stderr,"WARNING: target does not appear to have memory support.\n");
 		fprintf(stderr,"         Reliable communication impossible!\n");
 	}
+	if ( pmtuEna_ ) {
+		searchMtu();
+	}
+	if ( tsReq_ && ! tsEna_ ) {
+		// after probing which reads the socket directly
+		opt = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE
+		    | SOF_TIMESTAMPING_SOFTWARE    | SOF_TIMESTAMPING_OPT_TSONLY;
+		if ( setsockopt( poll_[0].fd, SOL_SOCKET, SO_TIMESTAMPING, &opt, sizeof(opt) ) ) {
+			fprintf(stderr,"Warning: Unable to enable SO_TIMESTAMPING (%s) -- no timestamps\n", strerror(errno));
+		} else {
+			// and room for whatever else comes along
+			tsCtl_.resize( CMSG_SPACE(sizeof(struct scm_timestamping)) + 256 );
+			tsEna_ = true;
+		}
+	}
+}
+
+unsigned
+JtagDriverUdp::pathMtu()
+{
+unsigned  mtu;
+socklen_t slen = sizeof(mtu);
+
+	if ( getsockopt( poll_[0].fd, IPPROTO_IP, IP_MTU, &mtu, &slen ) ) {
+		return mtu_;
+	}
+	mtu = mtu > MAX_UDP_PLD + IP_UDP_HDR ? MAX_UDP_PLD : mtu - IP_UDP_HDR;
+	return mtu < mtuMax_ ? mtu : mtuMax_;
+}
+
+// send a query padded to 'len' octets; returns 1 if the target
+// replied (which also yields an RTT sample), 0 if not (or the kernel
+// refused it) and -1 if the target rejected the padded query
+int
+JtagDriverUdp::probeMtu(unsigned len)
+{
+unsigned        qsz;
+int             got;
+Header          h;
+struct timespec then, now;
+
+	if ( prbBuf_.size() < len ) {
+		prbBuf_.resize( len );
+	}
+
+	// late replies to earlier probes
+	while ( recv( poll_[0].fd, &prbBuf_[0], prbBuf_.size(), MSG_DONTWAIT ) > 0 )
+		;
+
+	qsz = fmtQuery( &prbBuf_[0] );
+	memset( &prbBuf_[qsz], 0, len - qsz );
+
+	nPmtuProbes_++;
+	nTxCalls_++;
+	nTxMsgs_++;
+	clock_gettime( CLOCK_MONOTONIC, &then );
+	if ( write( poll_[0].fd, &prbBuf_[0], len ) < 0 ) {
+		if ( EMSGSIZE == errno ) {
+			// exceeds the known path MTU
+			return 0;
+		}
+		throw SysErr("JtagDriverUdp: unable to send");
+	}
+
+	execUs_ = 0;
+	while ( (got = waitReply()) > 0 ) {
+		if ( (poll_[0].revents & POLLERR) && EMSGSIZE == sockErr() ) {
+			// the probe exceeds the path MTU (ICMP)
+			pmtuUpdate();
+			return 0;
+		}
+		if ( ! (poll_[0].revents & POLLIN) ) {
+			continue;
+		}
+		nRxCalls_++;
+		nRxMsgs_++;
+		if ( (got = read( poll_[0].fd, &prbBuf_[0], prbBuf_.size() )) < 0 ) {
+			if ( EMSGSIZE == errno ) {
+				pmtuUpdate();
+				return 0;
+			}
+			throw SysErr("JtagDriverUdp -- recvmsg failed");
+		}
+		if ( got < (int)sizeof(Header) ) {
+			continue;
+		}
+		h = getHdr( &prbBuf_[0] );
+		if ( getErr( h ) ) {
+			return -1;
+		}
+		if ( CMD_Q == getCmd( h ) ) {
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			rttSample( (double)(now.tv_sec - then.tv_sec)*1.0E6 + (double)(now.tv_nsec - then.tv_nsec)/1.0E3 );
+			return 1;
+		}
+	}
+	if ( got < 0 ) {
+		throw SysErr("JtagDriverUdp: poll failed");
+	}
+	return 0;
+}
+
+void
+JtagDriverUdp::searchMtu()
+{
+unsigned wsz = getWordSize();
+unsigned hi  = pathMtu();
+unsigned lo  = hi < MIN_UDP_PLD ? hi : MIN_UDP_PLD;
+unsigned mid, i;
+int      st  = 0;
+
+	// the smallest first; this also yields the RTT which sets
+	// the timeout of the probes that don't get through
+	for ( i = 0; i < PMTU_TRIES && 0 == (st = probeMtu( lo )); i++ )
+		;
+	if ( st < 0 ) {
+		fprintf(stderr,"Warning: target rejects padded queries; unable to probe the path MTU\n");
+		return;
+	}
+	if ( 0 == st ) {
+		fprintf(stderr,"Warning: unable to probe the path MTU -- using %d\n", mtu_);
+		return;
+	}
+	// then the largest; usually that's it
+	for ( i = 0; i < PMTU_TRIES && 0 == (st = probeMtu( hi )); i++ )
+		;
+	if ( st <= 0 ) {
+		// 'lo' gets through, 'hi' doesn't
+		while ( hi - lo > wsz ) {
+			mid = lo + ((hi - lo)/2/wsz)*wsz;
+			for ( i = 0; i < PMTU_TRIES && 0 == (st = probeMtu( mid )); i++ )
+				;
+			if ( st > 0 ) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+		hi = lo;
+	}
+
+	if ( hi > mtu_ ) {
+		// receive buffers must grow
+		rxSlotSz_ = 0;
+	}
+	mtu_ = hi;
+
+	if ( getDebug() > 0 ) {
+		fprintf(stderr,"Path MTU probing: datagrams of up to %d octets (%lu probes)\n", mtu_, nPmtuProbes_);
+	}
+}
+
+// read and clear the pending socket error (an ICMP error reported
+// for a datagram we sent)
+int
+JtagDriverUdp::sockErr()
+{
+int       err  = 0;
+socklen_t slen = sizeof(err);
+
+	if ( getsockopt( poll_[0].fd, SOL_SOCKET, SO_ERROR, &err, &slen ) ) {
+		throw SysErr("JtagDriverUdp -- unable to read SO_ERROR");
+	}
+	return err;
+}
+
+bool
+JtagDriverUdp::pmtuUpdate()
+{
+unsigned mtu = pathMtu();
+
+	if ( mtu >= mtu_ ) {
+		return false;
+	}
+	fprintf(stderr,"Path MTU dropped; limiting datagrams to %d octets\n", mtu);
+	mtu_ = mtu;
+	nPmtuDrops_++;
+	return true;
+}
+
+uint32_t
+JtagDriverUdp::transportCaps()
+{
+	return segEna_ ? CAP_SEG : 0;
+}
+
+bool
+JtagDriverUdp::segOn()
+{
+	return segEna_ && (getTargetCaps() & CAP_SEG);
+}
+
+unsigned
+JtagDriverUdp::segFrag()
+{
+unsigned wsz = getWordSize();
+
+	// payload of a frame; whole words
+	return ((mtu_ - SEG_HSIZE)/wsz)*wsz;
 }
 
 unsigned long
-JtagDriverUdp::getMaxVectorSize()
+JtagDriverUdp::getMaxMsgVectorSize()
 {
+unsigned      wsz       = getWordSize();
 // MTU lim; 2*vector size + header must fit!
-unsigned long mtuLim    = (mtu_ - getWordSize()) / 2;
+unsigned long mtuLim    = (mtu_ - wsz) / 2;
+
+		if ( segOn() ) {
+			// the target memory lim; the frames must be numbered
+			mtuLim = (MAX_SEGS * segFrag() - 2*wsz) / 2;
+			if ( getMemDepth() && mtuLim > getMemDepth() * wsz ) {
+				mtuLim = getMemDepth() * wsz;
+			}
+			mtuLim = (mtuLim / wsz) * wsz;
+		}
 
 		return mtuLim;
 }
 
+unsigned long
+JtagDriverUdp::getMaxVectorSize()
+{
+	// we can keep a window of messages in flight
+	return getMaxMsgVectorSize() * getWindow();
+}
+
+bool
+JtagDriverUdp::canPipeline()
+{
+	return true;
+}
+
+void
+JtagDriverUdp::rttSample(double us)
+{
+double rto;
+
+	if ( ! rttValid_ ) {
+		srttUs_   = us;
+		rttvarUs_ = us/2.0;
+		rttValid_ = true;
+	} else {
+		rttvarUs_ = 0.75*rttvarUs_ + 0.25*fabs( srttUs_ - us );
+		srttUs_   = 0.875*srttUs_  + 0.125*us;
+	}
+	nRttSamples_++;
+
+	// this also undoes any backoff
+	rto = srttUs_ + 4.0*rttvarUs_;
+	if ( rto < rtoMinUs_ ) {
+		rtoUs_ = rtoMinUs_;
+	} else if ( rto > rtoMaxUs_ ) {
+		rtoUs_ = rtoMaxUs_;
+	} else {
+		rtoUs_ = (unsigned) rto;
+	}
+}
+
+void
+JtagDriverUdp::noteSent(uint8_t *txb)
+{
+Header   hdr = getHdr( txb );
+TxRec   *r   = &txRecs_[ getXid( hdr ) ];
+unsigned exec = 0;
+
+	// CMD_C carries the number of cycles, too
+	if ( getCmd( hdr ) == CMD_S || getCmd( hdr ) == CMD_Z || getCmd( hdr ) == CMD_C ) {
+		exec = (unsigned)( (unsigned long long)getMsgLen( txb, getWordSize() ) * getPeriodNs() / 1000ULL );
+	}
+	if ( exec > execUs_ ) {
+		execUs_ = exec;
+	}
+
+	// the reply to a query has no XID
+	if ( (qryOut_ = ( getCmd( hdr ) == CMD_Q )) ) {
+		return;
+	}
+
+	if ( r->valid_ && r->hdr_ == hdr ) {
+		// retransmission; the reply is ambiguous
+		r->resent_ = true;
+		return;
+	}
+	if ( ! r->valid_ ) {
+		nOut_++;
+	}
+	r->valid_  = true;
+	r->acked_  = false;
+	r->resent_ = false;
+	r->hdr_    = hdr;
+	r->execUs_ = exec;
+	r->buf_    = 0;
+	clock_gettime( CLOCK_MONOTONIC, &r->sent_ );
+}
+
+// a reply (or frame) to a message that is not in flight is counted
+bool
+JtagDriverUdp::inFlight(TxRec *r)
+{
+	if ( r->valid_ ) {
+		return true;
+	}
+	if ( r->acked_ ) {
+		nDups_++;
+	} else {
+		nStale_++;
+	}
+	return false;
+}
+
+// returns false if the reply must be dropped
+bool
+JtagDriverUdp::noteRcvd(uint8_t *hdbuf)
+{
+Header          h   = getHdr( hdbuf );
+Xid             xid = getXid( h );
+TxRec          *r   = &txRecs_[ xid ];
+struct timespec now;
+double          us;
+
+	if ( getCmd( h ) == CMD_Q || ( qryOut_ && getErr( h ) ) ) {
+		if ( ! qryOut_ ) {
+			nStale_++;
+			return false;
+		}
+		qryOut_ = false;
+		return true;
+	}
+
+	if ( ! inFlight( r ) ) {
+		return false;
+	}
+	r->valid_ = false;
+	r->acked_ = true;
+	nOut_--;
+
+	// overtaken by the reply to a later message
+	if ( (Xid)(rcvdXid_ - xid) < 128 && rcvdXid_ != xid ) {
+		nReord_++;
+	} else {
+		rcvdXid_ = xid;
+	}
+
+	if ( r->resent_ ) {
+		return true;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	us = (double)(now.tv_sec - r->sent_.tv_sec)*1.0E6 + (double)(now.tv_nsec - r->sent_.tv_nsec)/1.0E3;
+	us -= r->execUs_;
+	rttSample( us > 0.0 ? us : 0.0 );
+	return true;
+}
+
+// with a single message in flight anything else outstanding was given
+// up by the caller; replies to it are stale.
+void
+JtagDriverUdp::dropStale(Header keep)
+{
+unsigned i;
+bool     qry = ( getCmd( keep ) == CMD_Q );
+
+	if ( ! nOut_ ) {
+		return;
+	}
+	for ( i = 0; i < sizeof(txRecs_)/sizeof(txRecs_[0]); i++ ) {
+		if ( txRecs_[i].valid_ && ( qry || i != getXid( keep ) ) ) {
+			txRecs_[i].valid_ = false;
+			txRecs_[i].acked_ = false;
+			nOut_--;
+		}
+	}
+}
+
+int
+JtagDriverUdp::waitReply()
+{
+struct timespec then, now, tmo;
+int             got = 0;
+unsigned long   us  = (unsigned long)rtoUs_ + execUs_;
+unsigned long   spent;
+
+	poll_[0].revents = 0;
+
+	if ( spinUs_ ) {
+		// poll without sleeping; saves the wakeup latency if the
+		// reply arrives quickly
+		clock_gettime( CLOCK_MONOTONIC, &then );
+		do {
+			nPolls_++;
+			if ( (got = poll( poll_, sizeof(poll_)/sizeof(poll_[0]), 0 )) ) {
+				return got;
+			}
+			clock_gettime( CLOCK_MONOTONIC, &now );
+			spent = (now.tv_sec - then.tv_sec)*1000000 + (now.tv_nsec - then.tv_nsec)/1000;
+		} while ( spent < spinUs_ );
+		// the timeout includes the time spent spinning
+		if ( spent >= us ) {
+			return 0;
+		}
+		us -= spent;
+	}
+
+	tmo.tv_sec  = us / 1000000;
+	tmo.tv_nsec = (us % 1000000) * 1000;
+	nPolls_++;
+	return ppoll( poll_, sizeof(poll_)/sizeof(poll_[0]), &tmo, 0 );
+}
+
 int
 JtagDriverUdp::xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
 {
 int got;
 
+	// single message in flight
+	dropStale( getHdr( txb ) );
+	if ( tsEna_ ) {
+		tsStart();
+	}
+	execUs_ = 0;
+	submit( txb, txBytes );
+	got = complete( hdbuf, hsize, rxb, size );
+	if ( tsEna_ ) {
+		tsDone();
+	}
+	return got;
+}
+
+bool
+JtagDriverUdp::canXferv()
+{
+	return sg_;
+}
+
+int
+JtagDriverUdp::xferv( const struct iovec *iov, unsigned iovcnt, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+unsigned i, len;
+int      got;
+
+	for ( i = 0, len = 0; i < iovcnt; i++ ) {
+		len += iov[i].iov_len;
+	}
+	if ( len > mtu_ && segOn() ) {
+		// must be segmented; gather first
+		return JtagDriverAxisToJtag::xferv( iov, iovcnt, hdbuf, hsize, rxb, size );
+	}
+
+	dropStale( getHdr( (uint8_t*)iov[0].iov_base ) );
+	if ( tsEna_ ) {
+		tsStart();
+	}
+	execUs_ = 0;
+	noteSent( (uint8_t*)iov[0].iov_base );
+
+	memset( &msgh_, 0, sizeof(msgh_) );
+	msgh_.msg_iov    = (struct iovec*)iov;
+	msgh_.msg_iovlen = iovcnt;
+
+	if ( nTx_ ) {
+		flushTx();
+	}
+	nTxCalls_++;
+	nTxMsgs_++;
+	if ( sendmsg( poll_[0].fd, &msgh_, 0 ) < 0 ) {
+		sendErr();
+	}
+	got = complete( hdbuf, hsize, rxb, size );
+	if ( tsEna_ ) {
+		tsDone();
+	}
+	return got;
+}
+
+void
+JtagDriverUdp::sendErr()
+{
+	if ( EMSGSIZE == errno ) {
+		if ( pmtuEna_ && segOn() ) {
+			// the path MTU dropped (ICMP); treat the datagram as lost.
+			// A message is retransmitted in smaller frames.
+			pmtuUpdate();
+			return;
+		}
+		fprintf(stderr, "UDP message size too large; would require fragmentation!\n");
+		fprintf(stderr, "Try to reduce using the driver option -- -m <mtu_size>.\n");
+	}
+	throw SysErr("JtagDriverUdp: unable to send");
+}
+
+void
+JtagDriverUdp::submit( uint8_t *txb, unsigned txBytes )
+{
+Xid    xid;
+TxRec *r;
+RxAsm *a;
+
+	noteSent( txb );
+
+	if ( txBytes > mtu_ && segOn() ) {
+		if ( txBytes > MAX_SEGS * segFrag() ) {
+			throw std::runtime_error("JtagDriverUdp: message too long to be segmented");
+		}
+		xid = getXid( getHdr( txb ) );
+		r   = &txRecs_[xid];
+		a   = &rxAsm_[xid];
+		if ( r->resent_ && r->buf_ ) {
+			// ask for what's missing; the target resends what we
+			// lack of the reply or tells us what it lacks
+			queueFrame( mkSegHdr( xid, 0, SEG_STATUS ), 0, a->map_, sizeof(a->map_) );
+		} else {
+			r->buf_   = txb;
+			r->len_   = txBytes;
+			r->frag_  = segFrag();
+			a->have_  = 0;
+			a->nSegs_ = 0;
+			a->len_   = 0;
+			memset( a->map_, 0, sizeof(a->map_) );
+			queueFrames( xid, 0 );
+			nSegMsgs_++;
+		}
+		if ( ! batch_ ) {
+			flushTx();
+		}
+		return;
+	}
+
+	if ( batch_ ) {
+		// sent by the next 'complete()'
+		queueTx( txb, txBytes );
+		return;
+	}
+
+	nTxCalls_++;
+	nTxMsgs_++;
 	if ( write( poll_[0].fd, txb, txBytes ) < 0 ) {
-		if ( EMSGSIZE == errno ) {
-			fprintf(stderr, "UDP message size too large; would require fragmentation!\n");
-			fprintf(stderr, "Try to reduce using the driver option -- -m <mtu_size>.\n");
+		sendErr();
+	}
+}
+
+void
+JtagDriverUdp::queueTx(uint8_t *buf, unsigned len)
+{
+struct iovec *v;
+
+	if ( TX_QUEUE == nTx_ ) {
+		flushTx();
+	}
+	v = &txIovs_[2*nTx_];
+	v[0].iov_base = buf;
+	v[0].iov_len  = len;
+	v[1].iov_base = 0;
+	v[1].iov_len  = 0;
+	nTx_++;
+}
+
+void
+JtagDriverUdp::queueFrame(Header fhdr, uint32_t off, uint8_t *buf, unsigned len)
+{
+struct iovec *v;
+
+	if ( TX_QUEUE == nTx_ ) {
+		flushTx();
+	}
+	setw32( txFrms_[nTx_],                  fhdr );
+	setw32( txFrms_[nTx_] + sizeof(Header), off  );
+	v = &txIovs_[2*nTx_];
+	v[0].iov_base = txFrms_[nTx_];
+	v[0].iov_len  = SEG_HSIZE;
+	v[1].iov_base = buf;
+	v[1].iov_len  = len;
+	nTx_++;
+}
+
+void
+JtagDriverUdp::queueFrames(Xid xid, const uint8_t *have)
+{
+TxRec   *r    = &txRecs_[xid];
+unsigned frag = r->frag_;
+unsigned num, off;
+bool     last;
+
+	if ( frag > segFrag() ) {
+		// the path MTU dropped; start over with smaller frames
+		if ( r->len_ > MAX_SEGS * segFrag() ) {
+			throw std::runtime_error("JtagDriverUdp: message too long to be segmented");
 		}
-		throw SysErr("JtagDriverUdp: unable to send");
+		frag     = segFrag();
+		r->frag_ = frag;
+		have     = 0;
 	}
 
-	poll_[0].revents = 0;
+	// all frames of the message or those missing from 'have'
+	for ( num = 0, off = 0; off < r->len_; num++, off += frag ) {
+		if ( have && (have[num/8] & (1 << (num % 8))) ) {
+			continue;
+		}
+		last = ( off + frag >= r->len_ );
+		queueFrame( mkSegHdr( xid, num, last ? SEG_LAST : 0 ), off, r->buf_ + off, last ? r->len_ - off : frag );
+		if ( have ) {
+			nSegResent_++;
+		}
+	}
+}
+
+unsigned
+JtagDriverUdp::txLen(unsigned i)
+{
+	return txIovs_[2*i].iov_len + txIovs_[2*i + 1].iov_len;
+}
 
-	got = poll( poll_, sizeof(poll_)/sizeof(poll_[0]), timeoutMs_ /* ms */ );
+unsigned
+JtagDriverUdp::gsoRun(unsigned i)
+{
+unsigned len = txLen( i );
+unsigned tot = len;
+unsigned n, l;
 
-	if ( got < 0 ) {
-		throw SysErr("JtagDriverUdp: poll failed");
+	// GSO: the kernel splits one datagram into segments of the size of
+	// the first one; only the last one may be shorter.
+	for ( n = 1; i + n < nTx_ && n < MAX_GSO_SEGS; n++ ) {
+		l = txLen( i + n );
+		if ( l > len || tot + l > MAX_UDP_PLD ) {
+			break;
+		}
+		tot += l;
+		if ( l < len ) {
+			n++;
+			break;
+		}
+	}
+	return n;
+}
+
+bool
+JtagDriverUdp::sendGso(unsigned i, unsigned n)
+{
+#ifdef UDP_SEGMENT
+union {
+	char           buf[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr align;
+}                ctl;
+struct cmsghdr  *cmsg;
+
+	memset( &msgh_, 0, sizeof(msgh_) );
+	msgh_.msg_iov        = &txIovs_[2*i];
+	msgh_.msg_iovlen     = 2*n;
+	msgh_.msg_control    = ctl.buf;
+	msgh_.msg_controllen = sizeof(ctl.buf);
+	cmsg                 = CMSG_FIRSTHDR( &msgh_ );
+	cmsg->cmsg_level     = IPPROTO_UDP;
+	cmsg->cmsg_type      = UDP_SEGMENT;
+	cmsg->cmsg_len       = CMSG_LEN(sizeof(uint16_t));
+	*(uint16_t*)CMSG_DATA( cmsg ) = txLen( i );
+	nTxCalls_++;
+	if ( sendmsg( poll_[0].fd, &msgh_, 0 ) >= 0 ) {
+		nTxMsgs_ += n;
+		return true;
+	}
+	if ( EMSGSIZE == errno ) {
+		nTx_ = 0;
+		sendErr();
+		// dropped
+		return true;
+	}
+	// e.g., no checksum offload on the route
+	fprintf(stderr, "Warning: UDP GSO failed (%s) -- using sendmmsg\n", strerror(errno));
+	gso_ = false;
+#endif
+	return false;
+}
+
+void
+JtagDriverUdp::sendMm(unsigned from, unsigned to)
+{
+unsigned i;
+int      st;
+
+	if ( from >= to ) {
+		return;
 	}
+	memset( txMsgs_ + from, 0, (to - from)*sizeof(txMsgs_[0]) );
+	for ( i = from; i < to; i++ ) {
+		txMsgs_[i].msg_hdr.msg_iov    = &txIovs_[2*i];
+		txMsgs_[i].msg_hdr.msg_iovlen = 2;
+	}
+	for ( i = from; i < to; i += st ) {
+		nTxCalls_++;
+		if ( (st = sendmmsg( poll_[0].fd, txMsgs_ + i, to - i, 0 )) < 0 ) {
+			nTxMsgs_ += i - from;
+			nTx_      = 0;
+			sendErr();
+			// the rest is dropped
+			return;
+		}
+	}
+	nTxMsgs_ += to - from;
+}
 
-	if ( got == 0 ) {
-		throw TimeoutErr();
+void
+JtagDriverUdp::flushTx()
+{
+unsigned i, n, sent;
+
+	// runs which qualify for GSO go out as one datagram each,
+	// everything else by sendmmsg
+	for ( i = sent = 0; i < nTx_; i += n ) {
+		n = 1;
+		if ( gso_ && (n = gsoRun( i )) > 1 ) {
+			sendMm( sent, i );
+			sent = nTx_ && sendGso( i, n ) ? i + n : i;
+		}
 	}
+	sendMm( sent, nTx_ );
+	nTx_ = 0;
+}
+
+int
+JtagDriverUdp::nextReply( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+uint8_t  *p;
+unsigned  got;
 
-	if ( poll_[0].revents & (POLLERR | POLLNVAL) ) {
-		throw std::runtime_error("JtagDriverUdp -- internal error; poll has POLLERR or POLLNVAL set");
+	if ( rxHead_ == rxSegs_.size() ) {
+		throw std::runtime_error("JtagDriverUdp -- recvmmsg with no data?");
 	}
 
-	if ( ! (poll_[0].revents & POLLIN) ) {
-		throw std::runtime_error("JtagDriverUdp -- poll with no data?");
+	p   = (uint8_t*)rxSegs_[rxHead_].iov_base;
+	got = rxSegs_[rxHead_].iov_len;
+	rxHead_++;
+
+	return rcvDgram( p, got, hdbuf, hsize, rxb, size );
+}
+
+// returns -1 if the datagram was consumed without completing a reply
+int
+JtagDriverUdp::rcvDgram( uint8_t *p, unsigned len, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+Header   h;
+Xid      xid;
+unsigned num, off;
+TxRec   *r;
+RxAsm   *a;
+
+	if ( len < hsize ) {
+		throw ProtoErr("JtagDriverUdp -- not enough header data received");
 	}
 
+	h = getHdr( p );
 
-	iovs_[0].iov_base = hdbuf;
-	iovs_[0].iov_len  = hsize;
-	iovs_[1].iov_base = rxb;
-	iovs_[1].iov_len  = size;
+	if ( ! segOn() || ! isSegFrame( h ) ) {
+		if ( ! noteRcvd( p ) ) {
+			return -1;
+		}
+		len -= hsize;
+		if ( len > size ) {
+			len = size;
+		}
+		memcpy( hdbuf, p, hsize );
+		memcpy( rxb, p + hsize, len );
 
-	got = readv( poll_[0].fd, iovs_, sizeof(iovs_)/sizeof(iovs_[0]) );
+		return len;
+	}
 
-	if ( debug_ > 1 ) {
-		fprintf(stderr, "HSIZE %d, SIZE %d, got %d\n", hsize ,size, got );
+	if ( len < SEG_HSIZE ) {
+		throw ProtoErr("JtagDriverUdp -- truncated segment frame");
 	}
 
-	if ( got < 0 ) {
-		throw SysErr("JtagDriverUdp -- recvmsg failed");
+	xid = getSegXid( h );
+	r   = &txRecs_[xid];
+	a   = &rxAsm_[xid];
+
+	if ( ! inFlight( r ) || ! r->buf_ ) {
+		return -1;
 	}
 
-	got -= hsize;
+	if ( (h & SEG_STATUS) ) {
+		if ( len < SEG_HSIZE + MAX_SEGS/8 ) {
+			throw ProtoErr("JtagDriverUdp -- truncated status frame");
+		}
+		// resend what the target lacks
+		queueFrames( xid, p + SEG_HSIZE );
+		return -1;
+	}
 
-	if ( got < 0 ) {
+	num  = getSegNum( h );
+	off  = getw32( p + sizeof(Header) );
+	len -= SEG_HSIZE;
+	if ( off + len > MAX_SEGS * mtu_ ) {
+		throw ProtoErr("JtagDriverUdp -- segmented reply too long");
+	}
+	if ( a->buf_.size() < off + len ) {
+		a->buf_.resize( off + len );
+	}
+	memcpy( &a->buf_[off], p + SEG_HSIZE, len );
+	if ( ! (a->map_[num/8] & (1 << (num % 8))) ) {
+		a->map_[num/8] |= (1 << (num % 8));
+		a->have_++;
+	}
+	if ( (h & SEG_LAST) ) {
+		a->nSegs_ = num + 1;
+		a->len_   = off + len;
+		if ( a->have_ < a->nSegs_ ) {
+			// frames were lost; ask for them rather than time out
+			queueFrame( mkSegHdr( xid, 0, SEG_STATUS ), 0, a->map_, sizeof(a->map_) );
+		}
+	}
+
+	if ( ! a->nSegs_ || a->have_ < a->nSegs_ ) {
+		return -1;
+	}
+
+	if ( a->len_ < hsize ) {
 		throw ProtoErr("JtagDriverUdp -- not enough header data received");
 	}
+	len = a->len_ - hsize;
+	if ( len > size ) {
+		len = size;
+	}
+	if ( ! noteRcvd( &a->buf_[0] ) ) {
+		return -1;
+	}
+	memcpy( hdbuf, &a->buf_[0], hsize );
+	memcpy( rxb, &a->buf_[hsize], len );
+
+	return len;
+}
+
+void
+JtagDriverUdp::drainRx()
+{
+unsigned        i, nRx, ctlSz, seg, off, len;
+int             got;
+struct cmsghdr *cmsg;
+struct iovec    v;
+
+	// a segmented reply takes several datagrams (unless GRO coalesces
+	// them); what doesn't fit is picked up by the next call.
+	nRx   = segOn() && ! gro_ ? MAX_WINDOW : getWindow();
+	ctlSz = CMSG_SPACE(sizeof(int));
+
+	if ( ! rxSlotSz_ ) {
+		// a GRO datagram holds many replies
+		rxSlotSz_ = gro_ ? MAX_GRO_PLD : mtu_;
+		rxBuf_.clear();
+	}
+	if ( rxBuf_.size() < nRx * rxSlotSz_ ) {
+		rxBuf_.resize( nRx * rxSlotSz_ );
+		rxCtl_.resize( nRx * ctlSz );
+	}
+
+	memset( rxMsgs_, 0, nRx*sizeof(rxMsgs_[0]) );
+	for ( i = 0; i < nRx; i++ ) {
+		rxIovs_[i].iov_base                = &rxBuf_[i*rxSlotSz_];
+		rxIovs_[i].iov_len                 = rxSlotSz_;
+		rxMsgs_[i].msg_hdr.msg_iov         = &rxIovs_[i];
+		rxMsgs_[i].msg_hdr.msg_iovlen      = 1;
+		if ( gro_ ) {
+			rxMsgs_[i].msg_hdr.msg_control    = &rxCtl_[i*ctlSz];
+			rxMsgs_[i].msg_hdr.msg_controllen = ctlSz;
+		}
+	}
+
+	nRxCalls_++;
+	if ( (got = recvmmsg( poll_[0].fd, rxMsgs_, nRx, MSG_DONTWAIT, 0 )) < 0 ) {
+		if ( EAGAIN != errno ) {
+			throw SysErr("JtagDriverUdp -- recvmmsg failed");
+		}
+		got = 0;
+	}
+
+	rxSegs_.clear();
+	rxHead_ = 0;
+	for ( i = 0; i < (unsigned)got; i++ ) {
+		len = rxMsgs_[i].msg_len;
+		seg = len;
+#ifdef UDP_GRO
+		for ( cmsg = CMSG_FIRSTHDR( &rxMsgs_[i].msg_hdr ); cmsg; cmsg = CMSG_NXTHDR( &rxMsgs_[i].msg_hdr, cmsg ) ) {
+			if ( IPPROTO_UDP == cmsg->cmsg_level && UDP_GRO == cmsg->cmsg_type ) {
+				seg = *(int*)CMSG_DATA( cmsg );
+			}
+		}
+#endif
+		for ( off = 0; off < len; off += seg ) {
+			v.iov_base = (uint8_t*)rxIovs_[i].iov_base + off;
+			v.iov_len  = len - off < seg ? len - off : seg;
+			rxSegs_.push_back( v );
+			nRxMsgs_++;
+		}
+	}
+}
+
+int
+JtagDriverUdp::complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+int got, err;
+
+	while ( 1 ) {
+
+		// replies that arrived already are handed out first; the messages
+		// submitted meanwhile are sent together before we have to wait.
+		if ( batch_ && rxHead_ < rxSegs_.size() ) {
+			if ( (got = nextReply( hdbuf, hsize, rxb, size )) >= 0 ) {
+				return got;
+			}
+			// a frame; maybe more to send
+			continue;
+		}
+
+		if ( nTx_ ) {
+			flushTx();
+		}
+
+		got = waitReply();
+
+		if ( got < 0 ) {
+			throw SysErr("JtagDriverUdp: poll failed");
+		}
+
+		if ( got == 0 ) {
+			nTimeouts_++;
+			// back off
+			rtoUs_ = 2*rtoUs_ > rtoMaxUs_ ? rtoMaxUs_ : 2*rtoUs_;
+			throw TimeoutErr();
+		}
+
+		// transmit timestamps are queued as errors
+		if ( tsEna_ && (poll_[0].revents & POLLERR) && rcvTxTs() ) {
+			poll_[0].revents &= ~POLLERR;
+			if ( ! (poll_[0].revents & POLLIN) ) {
+				continue;
+			}
+		}
+
+		if ( poll_[0].revents & POLLERR ) {
+			if ( EMSGSIZE == (err = sockErr()) ) {
+				// the path MTU dropped (ICMP); the datagram is lost.
+				// Resend now (a message in smaller frames).
+				pmtuUpdate();
+				throw TimeoutErr();
+			}
+			if ( err ) {
+				errno = err;
+				throw SysErr("JtagDriverUdp -- socket error");
+			}
+			poll_[0].revents &= ~POLLERR;
+			if ( ! (poll_[0].revents & (POLLIN | POLLNVAL)) ) {
+				continue;
+			}
+		}
+
+		if ( poll_[0].revents & POLLNVAL ) {
+			throw std::runtime_error("JtagDriverUdp -- internal error; poll has POLLNVAL set");
+		}
+
+		if ( ! (poll_[0].revents & POLLIN) ) {
+			throw std::runtime_error("JtagDriverUdp -- poll with no data?");
+		}
+
+		if ( batch_ ) {
+			drainRx();
+			continue;
+		}
 
+		if ( segOn() ) {
+			// may be a frame; receive into our buffer
+			if ( rxBuf_.size() < mtu_ ) {
+				rxBuf_.resize( mtu_ );
+			}
+			iovs_[0].iov_base = &rxBuf_[0];
+			iovs_[0].iov_len  = rxBuf_.size();
+			nRxCalls_++;
+			nRxMsgs_++;
+			if ( (got = rcvMsg( iovs_, 1 )) < 0 ) {
+				throw SysErr("JtagDriverUdp -- recvmsg failed");
+			}
+			if ( (got = rcvDgram( &rxBuf_[0], got, hdbuf, hsize, rxb, size )) >= 0 ) {
+				return got;
+			}
+			continue;
+		}
+
+		iovs_[0].iov_base = hdbuf;
+		iovs_[0].iov_len  = hsize;
+		iovs_[1].iov_base = rxb;
+		iovs_[1].iov_len  = size;
+
+		nRxCalls_++;
+		nRxMsgs_++;
+		got = rcvMsg( iovs_, sizeof(iovs_)/sizeof(iovs_[0]) );
+
+		if ( debug_ > 1 ) {
+			fprintf(stderr, "HSIZE %d, SIZE %d, got %d\n", hsize ,size, got );
+		}
+
+		if ( got < 0 ) {
+			throw SysErr("JtagDriverUdp -- recvmsg failed");
+		}
+
+		got -= hsize;
+
+		if ( got < 0 ) {
+			throw ProtoErr("JtagDriverUdp -- not enough header data received");
+		}
+
+		if ( ! noteRcvd( hdbuf ) ) {
+			// not for a message in flight; keep waiting
+			continue;
+		}
+
+		return got;
+	}
+}
+
+// reads a datagram; with timestamps (-T) also the time it was received
+ssize_t
+JtagDriverUdp::rcvMsg(struct iovec *iov, unsigned n)
+{
+struct msghdr   mh;
+struct cmsghdr *cmsg;
+ssize_t         got;
+
+	if ( ! tsEna_ ) {
+		return readv( poll_[0].fd, iov, n );
+	}
+
+	memset( &mh, 0, sizeof(mh) );
+	mh.msg_iov        = iov;
+	mh.msg_iovlen     = n;
+	mh.msg_control    = &tsCtl_[0];
+	mh.msg_controllen = tsCtl_.size();
+	if ( (got = recvmsg( poll_[0].fd, &mh, 0 )) >= 0 ) {
+		for ( cmsg = CMSG_FIRSTHDR( &mh ); cmsg; cmsg = CMSG_NXTHDR( &mh, cmsg ) ) {
+			if ( SOL_SOCKET == cmsg->cmsg_level && SCM_TIMESTAMPING == cmsg->cmsg_type ) {
+				// software stamp is the first one
+				memcpy( &tsRx_, CMSG_DATA( cmsg ), sizeof(tsRx_) );
+				tsRxOk_ = true;
+			}
+		}
+	}
 	return got;
 }
 
+static long
+nsDiff(const struct timespec *a, const struct timespec *b)
+{
+	return (long)(a->tv_sec - b->tv_sec)*1000000000L + (a->tv_nsec - b->tv_nsec);
+}
+
+// reads the transmit timestamps from the error queue; the first one
+// taken after the current 'xfer()' started is kept (others are left
+// over from a transfer that failed). Returns the number read.
+unsigned
+JtagDriverUdp::rcvTxTs()
+{
+struct msghdr   mh;
+struct cmsghdr *cmsg;
+struct timespec ts;
+unsigned        n;
+
+	for ( n = 0; ; n++ ) {
+		memset( &mh, 0, sizeof(mh) );
+		mh.msg_control    = &tsCtl_[0];
+		mh.msg_controllen = tsCtl_.size();
+		nRxCalls_++;
+		if ( recvmsg( poll_[0].fd, &mh, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 ) {
+			if ( EAGAIN == errno || EWOULDBLOCK == errno ) {
+				return n;
+			}
+			throw SysErr("JtagDriverUdp -- reading timestamps failed");
+		}
+		for ( cmsg = CMSG_FIRSTHDR( &mh ); cmsg; cmsg = CMSG_NXTHDR( &mh, cmsg ) ) {
+			if ( SOL_SOCKET == cmsg->cmsg_level && SCM_TIMESTAMPING == cmsg->cmsg_type ) {
+				memcpy( &ts, CMSG_DATA( cmsg ), sizeof(ts) );
+				if ( ! tsTxOk_ && nsDiff( &ts, &tsXfer_ ) >= 0 ) {
+					tsTx_   = ts;
+					tsTxOk_ = true;
+				}
+			}
+		}
+	}
+}
+
+void
+JtagDriverUdp::tsStart()
+{
+	tsTxOk_ = false;
+	tsRxOk_ = false;
+	clock_gettime( CLOCK_REALTIME, &tsXfer_ );
+}
+
+void
+JtagDriverUdp::tsDone()
+{
+struct timespec now;
+
+	clock_gettime( CLOCK_REALTIME, &now );
+	if ( ! tsTxOk_ ) {
+		rcvTxTs();
+	}
+
+	MtxLock lck( &tsMtx_ );
+
+	if ( ! tsTxOk_ || ! tsRxOk_ ) {
+		nTsMissed_++;
+		return;
+	}
+	nTsXfers_++;
+	tsWire_.add( nsDiff( &tsRx_, &tsTx_    ) );
+	tsSend_.add( nsDiff( &tsTx_, &tsXfer_  ) );
+	tsRecv_.add( nsDiff( &now,   &tsRx_    ) );
+}
+
+void
+JtagDriverUdp::tsDump(FILE *f)
+{
+unsigned b, lo, hi;
+char     lbl[32];
+
+	MtxLock lck( &tsMtx_ );
+
+	fprintf(f, "UDP transfers with timestamps: %lu (%lu without)\n", nTsXfers_, nTsMissed_);
+	if ( ! nTsXfers_ ) {
+		return;
+	}
+	for ( lo = 0; lo < TS_BUCKETS - 1 && ! (tsWire_.cnt_[lo] | tsSend_.cnt_[lo] | tsRecv_.cnt_[lo]); lo++ )
+		;
+	for ( hi = TS_BUCKETS - 1; hi > lo && ! (tsWire_.cnt_[hi] | tsSend_.cnt_[hi] | tsRecv_.cnt_[hi]); hi-- )
+		;
+	fprintf(f, "  time (us)            wire       send       recv\n");
+	for ( b = lo; b <= hi; b++ ) {
+		if ( 0 == b ) {
+			snprintf( lbl, sizeof(lbl), "< 1" );
+		} else if ( TS_BUCKETS - 1 == b ) {
+			snprintf( lbl, sizeof(lbl), ">= %lu", 1UL << (b - 1) );
+		} else {
+			snprintf( lbl, sizeof(lbl), "%lu..%lu", 1UL << (b - 1), 1UL << b );
+		}
+		fprintf(f, "  %-16s %10lu %10lu %10lu\n", lbl, tsWire_.cnt_[b], tsSend_.cnt_[b], tsRecv_.cnt_[b]);
+	}
+	fprintf(f, "  %-16s %10.1f %10.1f %10.1f\n", "mean",
+	        tsWire_.sumNs_/1000.0/nTsXfers_, tsSend_.sumNs_/1000.0/nTsXfers_, tsRecv_.sumNs_/1000.0/nTsXfers_);
+	fflush( f );
+}
+
+void *
+JtagDriverUdp::tsThread(void *)
+{
+sigset_t sigs;
+int      sig;
+unsigned i;
+
+	sigemptyset( &sigs );
+	sigaddset( &sigs, SIGUSR1 );
+	while ( 0 == sigwait( &sigs, &sig ) ) {
+		MtxLock lck( &tsDrvMtx );
+		for ( i = 0; i < tsDrvs.size(); i++ ) {
+			tsDrvs[i]->tsDump( stdout );
+		}
+	}
+	return 0;
+}
+
 void
 JtagDriverUdp::usage()
 {
-	printf("  UDP Driver options: [-m <mtu>]\n");
+	printf("  UDP Driver options: [-m <mtu>] [-f] [-b <us>] [-s <us>] [-w <n>] [-g] [-r <us>] [-R <us>] [-n <n>] [-Z] [-k <cycles>] [-P <vers>] [-M] [-G] [-X] [-d] [-T]\n");
 	printf("  -m <mtu>    : Set MTU limit for UDP datagrams (must not be fragmented!)\n");
 	printf("  -f          : Enable IP fragmentation - note that FW does probably not support this!\n");
+	printf("  -b <us>     : Busy-poll the socket for <us> microseconds (SO_BUSY_POLL)\n");
+	printf("  -s <us>     : Spin (poll w/o sleeping) for up to <us> microseconds before\n");
+	printf("                blocking for a reply\n");
+	printf("  -w <n>      : Keep at most <n> messages in flight (if the target supports\n");
+	printf("                protocol version 1; default: as many as the target supports)\n");
+	printf("  -g          : Send directly from the TMS/TDI vectors (scatter-gather) rather\n");
+	printf("                than interleaving them into a buffer first\n");
+	printf("  -r <us>     : Lower limit of the retransmission timeout (default %u)\n", DFLT_RTO_MIN_US);
+	printf("  -R <us>     : Upper limit (and initial value) of the retransmission timeout\n");
+	printf("                (default %u); the timeout follows the measured round-trip time\n", DFLT_RTO_MAX_US);
+	printf("                in between. Use -r <us> -R <us> for a fixed timeout.\n");
+	printf("  -n <n>      : Retransmit at most <n> times before giving up (default %u);\n", DFLT_RETRIES);
+	printf("                the timeout doubles with every retransmission\n");
+	printf("  -Z          : Don't use compressed (run-length encoded) shift messages\n");
+	printf("  -k <cycles> : Clock idle runs (RTI, Pause-DR/IR, Test-Logic-Reset with constant\n");
+	printf("                TDI) of at least <cycles> by a single command (if the target\n");
+	printf("                supports it); 0: runs worth a full message. The TDO of such\n");
+	printf("                a run is reported as zeros. Default: off\n");
+	printf("  -P <vers>   : Highest protocol version to try (default %u)\n", PVERS >> 30);
+	printf("  -M          : Batch system calls; send a window of messages with one sendmmsg\n");
+	printf("                and receive all replies that arrived with one recvmmsg\n");
+	printf("  -G          : Like -M but send a window as a single UDP GSO datagram\n");
+	printf("                (UDP_SEGMENT) and let the kernel coalesce replies (UDP_GRO)\n");
+	printf("  -X          : Don't segment messages; by default a message may use the\n");
+	printf("                full target memory and is sent as several datagrams if the\n");
+	printf("                target supports it\n");
+	printf("  -d          : Don't probe the path MTU; by default the largest datagram (up to\n");
+	printf("                the -m limit) that the path and the target accept is searched\n");
+	printf("                for with padded queries\n");
+	printf("  -T          : Kernel timestamps (SO_TIMESTAMPING); histograms of the time\n");
+	printf("                on the wire and in xvcSrv per transfer are printed on SIGUSR1\n");
+	printf("                and when a client disconnects (not with -M, -G)\n");
+}
+
+void
+JtagDriverUdp::getCaps(Caps *caps)
+{
+	JtagDriverAxisToJtag::getCaps( caps );
+	if ( spinUs_ ) {
+		caps->waitMode_ = WAIT_POLL;
+		caps->spinUs_   = spinUs_;
+	}
+}
+
+void
+JtagDriverUdp::dumpInfo(FILE *f)
+{
+	JtagDriverAxisToJtag::dumpInfo( f );
+	fprintf(f, "Retransmission Timeout (us) %u (limits %u..%u)\n", rtoUs_, rtoMinUs_, rtoMaxUs_);
+	if ( rttValid_ ) {
+		fprintf(f, "Smoothed RTT (us)           %.1f (+/- %.1f; %lu samples)\n", srttUs_, rttvarUs_, nRttSamples_);
+	}
+	fprintf(f, "Timeouts                    %lu\n", nTimeouts_);
+	fprintf(f, "Dropped Replies             %lu stale, %lu duplicate (%lu reordered)\n", nStale_, nDups_, nReord_);
+	if ( batch_ ) {
+		fprintf(f, "Batched Syscalls            %s\n", gso_ ? "GSO/GRO" : "sendmmsg/recvmmsg");
+	}
+	fprintf(f, "Kernel Timestamps           %s\n", tsEna_ ? "software (SIGUSR1 prints histograms)" : "off");
+	fprintf(f, "Datagram Size Limit         %u%s\n", mtu_, pmtuEna_ ? " (probed)" : "");
+	if ( nPmtuDrops_ ) {
+		fprintf(f, "Path MTU Drops              %lu\n", nPmtuDrops_);
+	}
+	if ( segOn() ) {
+		fprintf(f, "Segmented Messages          %lu (%u octets/frame; %lu frames resent)\n", nSegMsgs_, segFrag(), nSegResent_);
+	}
+}
+
+void
+JtagDriverUdp::connDone()
+{
+	if ( getDebug() > 0 ) {
+		printf("UDP syscalls: %lu send (%lu datagrams), %lu poll, %lu recv (%lu datagrams)\n",
+		       nTxCalls_, nTxMsgs_, nPolls_, nRxCalls_, nRxMsgs_);
+		printf("UDP replies dropped: %lu stale, %lu duplicate (%lu reordered)\n",
+		       nStale_, nDups_, nReord_);
+	}
+	if ( tsEna_ ) {
+		tsDump( stdout );
+		MtxLock lck( &tsMtx_ );
+		nTsXfers_  = 0;
+		nTsMissed_ = 0;
+		tsWire_.reset();
+		tsSend_.reset();
+		tsRecv_.reset();
+	}
 }
 
 static DriverRegistrar<JtagDriverUdp> r("udp");
@@ -27,12 +27,202 @@ private:
 
 	struct pollfd     poll_[1];
 
-	int               timeoutMs_;
+	// Retransmission timeout estimated from the round-trip time
+	// (Jacobson/Karels, RFC 6298) and clamped to [rtoMinUs_, rtoMaxUs_];
+	// doubled on every timeout. The TCK time needed to execute a shift
+	// is not part of the RTT samples but added to the timeout.
+	unsigned          rtoUs_;
+	unsigned          rtoMinUs_;
+	unsigned          rtoMaxUs_;
+	bool              rttValid_;
+	// smoothed RTT and variance (us)
+	double            srttUs_;
+	double            rttvarUs_;
+	unsigned long     nRttSamples_;
+	unsigned long     nTimeouts_;
+	// TCK time of the last message sent
+	unsigned          execUs_;
+
+	// per-XID send time; a message which was sent more than once
+	// yields no RTT sample (Karn's algorithm). A segmented message
+	// is kept ('buf_') until acknowledged so lost frames can be resent.
+	// 'valid_' marks a message in flight, 'acked_' one that was answered.
+	struct TxRec {
+		bool            valid_;
+		bool            acked_;
+		bool            resent_;
+		Header          hdr_;
+		unsigned        execUs_;
+		struct timespec sent_;
+		uint8_t        *buf_;
+		unsigned        len_;
+		unsigned        frag_;
+	};
+	TxRec             txRecs_[256];
+
+	// a reply to a message that is not in flight (anymore) is dropped
+	// on reception; it must not count as an attempt by 'xferRel()'.
+	// Duplicates answer a message that was answered already, stale
+	// replies one that was given up. A query reply carries no XID;
+	// it is accepted while a query is in flight ('qryOut_').
+	unsigned          nOut_;
+	bool              qryOut_;
+	Xid               rcvdXid_;
+	unsigned long     nStale_;
+	unsigned long     nDups_;
+	unsigned long     nReord_;
+
+	// per-XID reassembly of a segmented reply
+	struct RxAsm {
+		unsigned        have_;
+		unsigned        nSegs_;
+		unsigned        len_;
+		uint8_t         map_[MAX_SEGS/8];
+		vector<uint8_t> buf_;
+	};
+	RxAsm             rxAsm_[256];
 
 	struct msghdr     msgh_;
 	struct iovec      iovs_[2];
 
     unsigned          mtu_;
+
+	// path MTU probing (-d disables): at 'init()' the largest datagram
+	// the (DF) path and the target accept is searched for with padded
+	// queries; 'mtuMax_' is the upper limit (-m). 'mtu_' shrinks when a
+	// send fails with EMSGSIZE, i.e., after an ICMP 'fragmentation
+	// needed' lowered the path MTU.
+	bool              pmtuEna_;
+	unsigned          mtuMax_;
+	vector<uint8_t>   prbBuf_;
+	unsigned long     nPmtuProbes_;
+	unsigned long     nPmtuDrops_;
+
+	// busy-wait for a reply for up to 'spinUs_' before blocking
+	unsigned          spinUs_;
+
+	// send shift messages by scatter-gather (sendmsg)
+	bool              sg_;
+
+	// a message longer than the MTU is sent as several frames if the
+	// target supports it (CAP_SEG; -X disables)
+	bool              segEna_;
+	unsigned long     nSegMsgs_;
+	unsigned long     nSegResent_;
+
+	// batching (-M): 'submit()' defers messages and 'complete()' sends
+	// them with one sendmmsg (or as GSO datagrams; -G) and drains
+	// all available replies with one recvmmsg (coalesced by GRO; -G)
+	bool              batch_;
+	bool              gso_;
+	bool              gro_;
+	// queued datagrams; two iovecs each (frame header and payload)
+	static const unsigned TX_QUEUE = 4*MAX_WINDOW;
+	unsigned          nTx_;
+	struct mmsghdr    txMsgs_[TX_QUEUE];
+	struct iovec      txIovs_[2*TX_QUEUE];
+	uint8_t           txFrms_[TX_QUEUE][SEG_HSIZE];
+	unsigned          rxSlotSz_;
+	vector<uint8_t>   rxBuf_;
+	vector<uint8_t>   rxCtl_;
+	struct mmsghdr    rxMsgs_[MAX_WINDOW];
+	struct iovec      rxIovs_[MAX_WINDOW];
+	// received but not yet consumed datagrams
+	vector<struct iovec> rxSegs_;
+	unsigned          rxHead_;
+
+	// kernel timestamps (-T): the socket has datagrams stamped as they
+	// leave and enter the stack (SO_TIMESTAMPING, software). An 'xfer()'
+	// is split into the time on the wire (network and target) and the
+	// time xvcSrv takes to send the request and to pick up the reply.
+	// The histograms are printed on SIGUSR1 and when a client disconnects.
+	static const unsigned TS_BUCKETS = 21;
+
+	// log2 buckets of microseconds; [0] holds < 1us
+	struct TsHist {
+		unsigned long   cnt_[TS_BUCKETS];
+		double          sumNs_;
+
+		void reset()
+		{
+			memset( cnt_, 0, sizeof(cnt_) );
+			sumNs_ = 0.0;
+		}
+
+		void add(long ns)
+		{
+		unsigned b;
+		long     us;
+
+			if ( ns < 0 ) {
+				ns = 0;
+			}
+			for ( b = 0, us = ns/1000; us > 0 && b < TS_BUCKETS - 1; us >>= 1 ) {
+				b++;
+			}
+			cnt_[b]++;
+			sumNs_ += (double)ns;
+		}
+	};
+
+	bool              tsReq_;
+	bool              tsEna_;
+	pthread_mutex_t   tsMtx_;
+	// CLOCK_REALTIME as the kernel stamps: start of the 'xfer()', first
+	// datagram sent and last one received
+	struct timespec   tsXfer_, tsTx_, tsRx_;
+	bool              tsTxOk_, tsRxOk_;
+	unsigned long     nTsXfers_, nTsMissed_;
+	TsHist            tsWire_, tsSend_, tsRecv_;
+	vector<uint8_t>   tsCtl_;
+
+	// system calls and datagrams
+	unsigned long     nTxCalls_, nTxMsgs_;
+	unsigned long     nRxCalls_, nRxMsgs_;
+	unsigned long     nPolls_;
+
+	int               waitReply();
+
+	unsigned          pathMtu();
+	int               probeMtu(unsigned len);
+	void              searchMtu();
+	int               sockErr();
+	bool              pmtuUpdate();
+
+	bool              segOn();
+	unsigned          segFrag();
+	void              queueTx(uint8_t *buf, unsigned len);
+	void              queueFrame(Header fhdr, uint32_t off, uint8_t *buf, unsigned len);
+	void              queueFrames(Xid xid, const uint8_t *have);
+
+	unsigned          txLen(unsigned i);
+	unsigned          gsoRun(unsigned i);
+	bool              sendGso(unsigned i, unsigned n);
+	void              sendMm(unsigned from, unsigned to);
+	void              flushTx();
+	void              drainRx();
+	int               nextReply(uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size);
+	int               rcvDgram(uint8_t *p, unsigned len, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size);
+	void              sendErr();
+
+	void              noteSent(uint8_t *txb);
+	bool              noteRcvd(uint8_t *hdbuf);
+	bool              inFlight(TxRec *r);
+	void              dropStale(Header keep);
+	void              rttSample(double us);
+
+	ssize_t           rcvMsg(struct iovec *iov, unsigned n);
+	unsigned          rcvTxTs();
+	void              tsStart();
+	void              tsDone();
+	void              tsDump(FILE *f);
+	static void      *tsThread(void *arg);
+
+protected:
+	// CAP_SEG unless disabled (-X)
+	virtual uint32_t
+	transportCaps();
+
 public:
 
 	JtagDriverUdp(int argc, char *const argv[], const char *target);
@@ -43,9 +233,39 @@ public:
 	virtual unsigned long
 	getMaxVectorSize();
 
+	virtual unsigned long
+	getMaxMsgVectorSize();
+
 	virtual int
 	xfer( uint8_t *txb, unsigned txBytes, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
 
+	virtual bool
+	canXferv();
+
+	virtual int
+	xferv( const struct iovec *iov, unsigned iovcnt, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	virtual bool
+	canPipeline();
+
+	virtual void
+	submit( uint8_t *txb, unsigned txBytes );
+
+	virtual int
+	complete( uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size );
+
+	// polls if spinning (-s)
+	virtual void
+	getCaps(Caps *caps);
+
+	virtual void
+	dumpInfo(FILE *f);
+
+	// prints the syscall counts (if verbose) and the
+	// timestamp histograms (-T)
+	virtual void
+	connDone();
+
 	virtual ~JtagDriverUdp();
 
 	static void usage();
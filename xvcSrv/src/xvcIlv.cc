@@ -0,0 +1,280 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcIlv.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#define ILV_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ILV_NEON
+#include <arm_neon.h>
+#endif
+
+// zero-padded last TMS/TDI words
+static void
+ilvTail(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long rem, unsigned wsz)
+{
+	if ( rem ) {
+		memcpy( dst,             tms, rem       );
+		memset( dst + rem,       0,   wsz - rem );
+		memcpy( dst + wsz,       tdi, rem       );
+		memset( dst + wsz + rem, 0,   wsz - rem );
+	}
+}
+
+static void
+ilvScalar(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned wsz)
+{
+unsigned long whole = (bytes / wsz) * wsz;
+unsigned long i;
+
+	for ( i = 0; i < whole; i += wsz ) {
+		memcpy( dst, tms + i, wsz );
+		dst += wsz;
+		memcpy( dst, tdi + i, wsz );
+		dst += wsz;
+	}
+	ilvTail( dst, tms + i, tdi + i, bytes - whole, wsz );
+}
+
+// Same with the word size known at compile time; the memcpy()s
+// become plain loads and stores.
+template <unsigned W>
+static void
+ilvFixed(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long whole = (bytes / W) * W;
+unsigned long i;
+
+	for ( i = 0; i < whole; i += W ) {
+		memcpy( dst, tms + i, W );
+		dst += W;
+		memcpy( dst, tdi + i, W );
+		dst += W;
+	}
+	ilvTail( dst, tms + i, tdi + i, bytes - whole, W );
+}
+
+// The SIMD kernels process as many full registers as possible
+// and leave the rest to the fixed-size kernel.
+
+#ifdef ILV_X86
+
+static void
+ilvSse2W4(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+__m128i       a, b;
+
+	for ( i = 0; i + 16 <= bytes; i += 16, dst += 32 ) {
+		a = _mm_loadu_si128( (const __m128i*)(tms + i) );
+		b = _mm_loadu_si128( (const __m128i*)(tdi + i) );
+		_mm_storeu_si128( (__m128i*)(dst     ), _mm_unpacklo_epi32( a, b ) );
+		_mm_storeu_si128( (__m128i*)(dst + 16), _mm_unpackhi_epi32( a, b ) );
+	}
+	ilvFixed<4>( dst, tms + i, tdi + i, bytes - i, 4 );
+}
+
+static void
+ilvSse2W8(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+__m128i       a, b;
+
+	for ( i = 0; i + 16 <= bytes; i += 16, dst += 32 ) {
+		a = _mm_loadu_si128( (const __m128i*)(tms + i) );
+		b = _mm_loadu_si128( (const __m128i*)(tdi + i) );
+		_mm_storeu_si128( (__m128i*)(dst     ), _mm_unpacklo_epi64( a, b ) );
+		_mm_storeu_si128( (__m128i*)(dst + 16), _mm_unpackhi_epi64( a, b ) );
+	}
+	ilvFixed<8>( dst, tms + i, tdi + i, bytes - i, 8 );
+}
+
+static void
+ilvSse2W16(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+
+	for ( i = 0; i + 16 <= bytes; i += 16, dst += 32 ) {
+		_mm_storeu_si128( (__m128i*)(dst     ), _mm_loadu_si128( (const __m128i*)(tms + i) ) );
+		_mm_storeu_si128( (__m128i*)(dst + 16), _mm_loadu_si128( (const __m128i*)(tdi + i) ) );
+	}
+	ilvTail( dst, tms + i, tdi + i, bytes - i, 16 );
+}
+
+// unpack works within 128-bit lanes; the lanes are put
+// in order by permute2x128.
+
+__attribute__((target("avx2")))
+static void
+ilvAvx2W4(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+__m256i       a, b, lo, hi;
+
+	for ( i = 0; i + 32 <= bytes; i += 32, dst += 64 ) {
+		a  = _mm256_loadu_si256( (const __m256i*)(tms + i) );
+		b  = _mm256_loadu_si256( (const __m256i*)(tdi + i) );
+		lo = _mm256_unpacklo_epi32( a, b );
+		hi = _mm256_unpackhi_epi32( a, b );
+		_mm256_storeu_si256( (__m256i*)(dst     ), _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+		_mm256_storeu_si256( (__m256i*)(dst + 32), _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+	}
+	ilvSse2W4( dst, tms + i, tdi + i, bytes - i, 4 );
+}
+
+__attribute__((target("avx2")))
+static void
+ilvAvx2W8(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+__m256i       a, b, lo, hi;
+
+	for ( i = 0; i + 32 <= bytes; i += 32, dst += 64 ) {
+		a  = _mm256_loadu_si256( (const __m256i*)(tms + i) );
+		b  = _mm256_loadu_si256( (const __m256i*)(tdi + i) );
+		lo = _mm256_unpacklo_epi64( a, b );
+		hi = _mm256_unpackhi_epi64( a, b );
+		_mm256_storeu_si256( (__m256i*)(dst     ), _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+		_mm256_storeu_si256( (__m256i*)(dst + 32), _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+	}
+	ilvSse2W8( dst, tms + i, tdi + i, bytes - i, 8 );
+}
+
+__attribute__((target("avx2")))
+static void
+ilvAvx2W16(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+__m256i       a, b;
+
+	for ( i = 0; i + 32 <= bytes; i += 32, dst += 64 ) {
+		a  = _mm256_loadu_si256( (const __m256i*)(tms + i) );
+		b  = _mm256_loadu_si256( (const __m256i*)(tdi + i) );
+		_mm256_storeu_si256( (__m256i*)(dst     ), _mm256_permute2x128_si256( a, b, 0x20 ) );
+		_mm256_storeu_si256( (__m256i*)(dst + 32), _mm256_permute2x128_si256( a, b, 0x31 ) );
+	}
+	ilvSse2W16( dst, tms + i, tdi + i, bytes - i, 16 );
+}
+
+#endif
+
+#ifdef ILV_NEON
+
+static void
+ilvNeonW4(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+uint32x4x2_t  v;
+
+	for ( i = 0; i + 16 <= bytes; i += 16, dst += 32 ) {
+		v.val[0] = vreinterpretq_u32_u8( vld1q_u8( tms + i ) );
+		v.val[1] = vreinterpretq_u32_u8( vld1q_u8( tdi + i ) );
+		vst2q_u32( (uint32_t*)dst, v );
+	}
+	ilvFixed<4>( dst, tms + i, tdi + i, bytes - i, 4 );
+}
+
+static void
+ilvNeonW8(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+uint8x16_t    a, b;
+
+	for ( i = 0; i + 16 <= bytes; i += 16, dst += 32 ) {
+		a = vld1q_u8( tms + i );
+		b = vld1q_u8( tdi + i );
+		vst1q_u8( dst     , vcombine_u8( vget_low_u8 ( a ), vget_low_u8 ( b ) ) );
+		vst1q_u8( dst + 16, vcombine_u8( vget_high_u8( a ), vget_high_u8( b ) ) );
+	}
+	ilvFixed<8>( dst, tms + i, tdi + i, bytes - i, 8 );
+}
+
+static void
+ilvNeonW16(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned)
+{
+unsigned long i;
+
+	for ( i = 0; i + 16 <= bytes; i += 16, dst += 32 ) {
+		vst1q_u8( dst     , vld1q_u8( tms + i ) );
+		vst1q_u8( dst + 16, vld1q_u8( tdi + i ) );
+	}
+	ilvTail( dst, tms + i, tdi + i, bytes - i, 16 );
+}
+
+#endif
+
+unsigned
+ilvKernels(unsigned wsz, IlvKernel *k, unsigned max)
+{
+unsigned n = 0;
+
+#define ILV_ADD(nm, fn) do { if ( n < max ) { k[n].name = nm; k[n].func = fn; n++; } } while (0)
+
+	ILV_ADD( "scalar", ilvScalar );
+
+	switch ( wsz ) {
+		case  4: ILV_ADD( "fixed", ilvFixed< 4> ); break;
+		case  8: ILV_ADD( "fixed", ilvFixed< 8> ); break;
+		case 16: ILV_ADD( "fixed", ilvFixed<16> ); break;
+		default: break;
+	}
+
+#ifdef ILV_X86
+	switch ( wsz ) {
+		case  4: ILV_ADD( "sse2", ilvSse2W4  ); break;
+		case  8: ILV_ADD( "sse2", ilvSse2W8  ); break;
+		case 16: ILV_ADD( "sse2", ilvSse2W16 ); break;
+		default: break;
+	}
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) ) {
+		switch ( wsz ) {
+			case  4: ILV_ADD( "avx2", ilvAvx2W4  ); break;
+			case  8: ILV_ADD( "avx2", ilvAvx2W8  ); break;
+			case 16: ILV_ADD( "avx2", ilvAvx2W16 ); break;
+			default: break;
+		}
+	}
+#endif
+
+#ifdef ILV_NEON
+	// NEON is a build-time option (-mfpu=neon on 32-bit ARM)
+	switch ( wsz ) {
+		case  4: ILV_ADD( "neon", ilvNeonW4  ); break;
+		case  8: ILV_ADD( "neon", ilvNeonW8  ); break;
+		case 16: ILV_ADD( "neon", ilvNeonW16 ); break;
+		default: break;
+	}
+#endif
+
+#undef ILV_ADD
+
+	return n;
+}
+
+IlvFunc
+ilvSelect(unsigned wsz)
+{
+IlvKernel k[8];
+
+	// the last one is the best
+	return k[ ilvKernels( wsz, k, sizeof(k)/sizeof(k[0]) ) - 1 ].func;
+}
@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_INTERLEAVE_H
+#define XVC_INTERLEAVE_H
+
+#include <stdint.h>
+
+// Kernels interleaving TMS and TDI vectors into the AxisToJtag
+// stream format:
+//
+//    TMS_WORD, TDI_WORD, TMS_WORD, TDI_WORD, ...
+//
+// 'bytes' is the length of each vector; if it is not a multiple
+// of the word size 'wsz' then the last TMS and TDI words are padded
+// with zeros. 'dst' must hold 2*ceil(bytes/wsz)*wsz octets.
+//
+// There is a scalar kernel for any word size; for word sizes 4, 8
+// and 16 there are also kernels specialized at compile time and SIMD
+// kernels (SSE2, AVX2, NEON). The best one is selected at run time
+// according to the CPU features.
+
+typedef void (*IlvFunc)(uint8_t *dst, const uint8_t *tms, const uint8_t *tdi, unsigned long bytes, unsigned wsz);
+
+typedef struct IlvKernel {
+	const char *name;
+	IlvFunc     func;
+} IlvKernel;
+
+// best kernel for word size 'wsz' on this CPU
+IlvFunc
+ilvSelect(unsigned wsz);
+
+// store up to 'max' kernels which support 'wsz' on this CPU in 'k'
+// (the scalar one first); returns the number of kernels.
+unsigned
+ilvKernels(unsigned wsz, IlvKernel *k, unsigned max);
+
+#endif
@@ -0,0 +1,105 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcRle.h>
+#include <string.h>
+
+// a run token costs 3 octets; shorter runs are
+// cheaper as part of a literal
+#define RLE_MIN_RUN 4
+
+static int
+putLiteral(uint8_t **pdst, unsigned long *pmax, const uint8_t *src, unsigned long n)
+{
+unsigned long l;
+
+	while ( n > 0 ) {
+		l = n > 128 ? 128 : n;
+		if ( l + 1 > *pmax ) {
+			return -1;
+		}
+		*(*pdst)++ = l - 1;
+		memcpy( *pdst, src, l );
+		*pdst += l;
+		*pmax -= l + 1;
+		src   += l;
+		n     -= l;
+	}
+	return 0;
+}
+
+unsigned long
+rleEncode(uint8_t *dst, unsigned long max, const uint8_t *src, unsigned long n)
+{
+uint8_t       *dst0 = dst;
+unsigned long  i, r, lit;
+
+	for ( i = lit = 0; i < n; i += r ) {
+		for ( r = 1; i + r < n && r < RLE_MAX_RUN && src[i + r] == src[i]; r++ )
+			;
+		if ( r < RLE_MIN_RUN ) {
+			// part of a literal
+			continue;
+		}
+		if ( putLiteral( &dst, &max, src + lit, i - lit ) || max < 3 ) {
+			return 0;
+		}
+		*dst++  = 0x80 | ((r - 1) >> 8);
+		*dst++  = (r - 1);
+		*dst++  = src[i];
+		max    -= 3;
+		lit     = i + r;
+	}
+	if ( putLiteral( &dst, &max, src + lit, n - lit ) ) {
+		return 0;
+	}
+	return dst - dst0;
+}
+
+long
+rleDecode(uint8_t *dst, unsigned long n, const uint8_t *src, unsigned long srcLen)
+{
+const uint8_t *src0 = src;
+const uint8_t *end  = src + srcLen;
+unsigned long  l;
+
+	while ( n > 0 ) {
+		if ( src >= end ) {
+			return -1;
+		}
+		if ( *src & 0x80 ) {
+			if ( end - src < 3 ) {
+				return -1;
+			}
+			l = (((unsigned long)(src[0] & 0x7f) << 8) | src[1]) + 1;
+			if ( l > n ) {
+				return -1;
+			}
+			memset( dst, src[2], l );
+			src += 3;
+		} else {
+			l = (unsigned long)src[0] + 1;
+			if ( l > n || (unsigned long)(end - src) < l + 1 ) {
+				return -1;
+			}
+			memcpy( dst, src + 1, l );
+			src += l + 1;
+		}
+		dst += l;
+		n   -= l;
+	}
+	return src - src0;
+}
@@ -0,0 +1,46 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description:
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#ifndef XVC_RLE_H
+#define XVC_RLE_H
+
+#include <stdint.h>
+
+// Run-length encoding of JTAG bit vectors (compressed JTAG command,
+// see README). A vector of 'n' octets is encoded as a sequence of
+// tokens:
+//
+//    0x00..0x7f, d[0..c]    : literal; the next c+1 octets
+//    0x80..0xff, l, d       : run; ((c & 0x7f) << 8 | l) + 1 copies of d
+//
+// The decoder knows 'n' (from the vector length in the header) and
+// stops after producing 'n' octets.
+
+// max. length of a single run
+#define RLE_MAX_RUN 32768
+
+// encode 'n' octets from 'src' into 'dst'; returns the encoded
+// length or 0 if it would exceed 'max'.
+unsigned long
+rleEncode(uint8_t *dst, unsigned long max, const uint8_t *src, unsigned long n);
+
+// decode 'n' octets into 'dst' from 'src' holding 'srcLen' octets;
+// returns the number of octets consumed or -1 if 'src' is malformed
+// or too short.
+long
+rleDecode(uint8_t *dst, unsigned long n, const uint8_t *src, unsigned long srcLen);
+
+#endif
@@ -16,15 +16,24 @@
 
 #include <xvcSrv.h>
 #include <xvcConn.h>
+#include <xvcBufPool.h>
 #include <xvcDrvLoopBack.h>
 #include <xvcDrvUdp.h>
+#include <xvcDrvLayer.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include <math.h>
+#include <unistd.h>
+#include <memory>
 #include <jtagDump.h>
+#include <xvcRle.h>
 
 // To be defined by Makefile
 #ifndef XVC_SRV_VERSION
@@ -35,6 +44,9 @@
 #define DEFAULTDRVNAME "udp"
 #endif
 
+// seconds between attempts to initialize a driver
+#define INIT_RETRY_S 5
+
 JtagDriver::JtagDriver(int argc, char *const argv[], unsigned debug)
 : debug_ ( debug ),
   drop_  ( 0     ),
@@ -72,6 +84,33 @@ JtagDriver::getSniff()
 	return debug_ & 0x100;
 }
 
+void
+JtagDriver::setHealthProbe(unsigned)
+{
+}
+
+bool
+JtagDriver::addXferHook(JtagXferHook *)
+{
+	return false;
+}
+
+void
+JtagDriver::connDone()
+{
+}
+
+void
+JtagDriver::getCaps(Caps *caps)
+{
+	caps->align_       = 1;
+	caps->maxInFlight_ = 1;
+	caps->zeroCopy_    = false;
+	caps->chunk_       = 0;
+	caps->waitMode_    = WAIT_BLOCK;
+	caps->spinUs_      = 0;
+}
+
 SysErr::SysErr(const char *prefix)
 : std::runtime_error( std::string(prefix) + std::string(": ") + std::string(::strerror(errno)) )
 {
@@ -92,12 +131,131 @@ static unsigned hdBufMax()
 	return 16;
 }
 
+// TAP controller states; TAP_U0..TAP_U4 mean 'unknown' after 0..4
+// consecutive TMS=1 bits (5 of them reset the TAP in any state).
+enum {
+	TAP_TLR, TAP_RTI,
+	TAP_SDR, TAP_CDR, TAP_SHDR, TAP_E1DR, TAP_PDR, TAP_E2DR, TAP_UDR,
+	TAP_SIR, TAP_CIR, TAP_SHIR, TAP_E1IR, TAP_PIR, TAP_E2IR, TAP_UIR,
+	TAP_U0,  TAP_U1,  TAP_U2,   TAP_U3,   TAP_U4,
+	TAP_NSTATES
+};
+
+// next state for TMS = 0, 1
+static const uint8_t tapNxt[TAP_NSTATES][2] = {
+	/* TLR  */ { TAP_RTI,  TAP_TLR  },
+	/* RTI  */ { TAP_RTI,  TAP_SDR  },
+	/* SDR  */ { TAP_CDR,  TAP_SIR  },
+	/* CDR  */ { TAP_SHDR, TAP_E1DR },
+	/* SHDR */ { TAP_SHDR, TAP_E1DR },
+	/* E1DR */ { TAP_PDR,  TAP_UDR  },
+	/* PDR  */ { TAP_PDR,  TAP_E2DR },
+	/* E2DR */ { TAP_SHDR, TAP_UDR  },
+	/* UDR  */ { TAP_RTI,  TAP_SDR  },
+	/* SIR  */ { TAP_CIR,  TAP_TLR  },
+	/* CIR  */ { TAP_SHIR, TAP_E1IR },
+	/* SHIR */ { TAP_SHIR, TAP_E1IR },
+	/* E1IR */ { TAP_PIR,  TAP_UIR  },
+	/* PIR  */ { TAP_PIR,  TAP_E2IR },
+	/* E2IR */ { TAP_SHIR, TAP_UIR  },
+	/* UIR  */ { TAP_RTI,  TAP_SDR  },
+	/* U0   */ { TAP_U0,   TAP_U1   },
+	/* U1   */ { TAP_U0,   TAP_U2   },
+	/* U2   */ { TAP_U0,   TAP_U3   },
+	/* U3   */ { TAP_U0,   TAP_U4   },
+	/* U4   */ { TAP_U0,   TAP_TLR  },
+};
+
+// state after clocking 8 TMS bits (LSB first)
+class TapByteTable {
+private:
+	uint8_t t_[TAP_NSTATES][256];
+public:
+	TapByteTable()
+	{
+	unsigned s, b, i, n;
+		for ( s = 0; s < TAP_NSTATES; s++ ) {
+			for ( b = 0; b < 256; b++ ) {
+				for ( n = s, i = 0; i < 8; i++ ) {
+					n = tapNxt[n][(b >> i) & 1];
+				}
+				t_[s][b] = n;
+			}
+		}
+	}
+
+	uint8_t operator()(unsigned s, uint8_t tms) const
+	{
+		return t_[s][tms];
+	}
+};
+
+static const TapByteTable tapByte;
+
+// the TAP does not drive TDO in these states if it stays there
+static bool
+tapIdle(unsigned s, uint8_t tms)
+{
+	switch ( s ) {
+		case TAP_RTI:
+		case TAP_PDR:
+		case TAP_PIR: return 0x00 == tms;
+		case TAP_TLR: return 0xff == tms;
+		default:      break;
+	}
+	return false;
+}
+
+static bool
+constWord(const uint8_t *p, unsigned wsz)
+{
+unsigned i;
+	if ( 0x00 != p[0] && 0xff != p[0] ) {
+		return false;
+	}
+	for ( i = 1; i < wsz; i++ ) {
+		if ( p[i] != p[0] ) {
+			return false;
+		}
+	}
+	return true;
+}
+
 JtagDriverAxisToJtag::JtagDriverAxisToJtag( int argc, char *const argv[], unsigned debug )
 : JtagDriver( argc, argv, debug ),
   wordSize_ ( sizeof(Header)    ),
+  wszKnown_ ( false             ),
   memDepth_ ( 1                 ),
   retry_    ( 5                 ),
-  periodNs_ ( UNKNOWN_PERIOD    )
+  maxRetry_ ( 5                 ),
+  xid_      ( XID_ANY           ),
+  periodNs_ ( UNKNOWN_PERIOD    ),
+  pvers_    ( PVER0             ),
+  maxVers_  ( PVERS             ),
+  nBufs_    ( 1                 ),
+  window_   ( 1                 ),
+  maxWindow_( MAX_WINDOW        ),
+  nRetrans_ ( 0                 ),
+  ilv_      ( ilvSelect( sizeof(Header) ) ),
+  fmt_      ( fmtSelect( sizeof(Header) ) ),
+  rle_      ( false             ),
+  rleEna_   ( true              ),
+  nRleTx_   ( 0                 ),
+  nRleRx_   ( 0                 ),
+  clk_      ( false             ),
+  clkEna_   ( false             ),
+  clkMin_   ( 0                 ),
+  tapState_ ( TAP_U0            ),
+  nClkCmds_ ( 0                 ),
+  tck_      ( false             ),
+  tckReqNs_ ( 0                 ),
+  tgtCaps_  ( 0                 ),
+  hooked_   ( false             ),
+  cacheValid_( false            ),
+  probeMs_  ( 0                 ),
+  probeRun_ ( false             ),
+  tgtLost_  ( false             ),
+  tgtResets_( 0                 )
 {
 	// start out with an initial header size; it might be increased
 	// once we contacted the server...
@@ -105,13 +263,28 @@ JtagDriverAxisToJtag::JtagDriverAxisToJtag( int argc, char *const argv[], unsign
 	txBuf_.reserve( bufSz_     );
 	hdBuf_.reserve( hdBufMax() );
 	hdBuf_.resize ( hdBufMax() ); // fill with zeros
+
+	lastXfer_.tv_sec  = 0;
+	lastXfer_.tv_nsec = 0;
+
+	pthread_mutex_init( &xferMtx_, 0 );
+}
+
+JtagDriverAxisToJtag::~JtagDriverAxisToJtag()
+{
+	// NOTE: the subclass is already gone at this point; a driver
+	//       which may be destroyed while the probe is running should
+	//       call setHealthProbe(0) from its own destructor.
+	setHealthProbe( 0 );
+	pthread_mutex_destroy( &xferMtx_ );
 }
 
 
 JtagDriverAxisToJtag::Header
 JtagDriverAxisToJtag::newXid()
 {
-	if ( XID_ANY == ++xid_ ) {
+	// XID_ANY is a valid XID (sequence number) in version 1
+	if ( XID_ANY == ++xid_ && PVER0 == pvers_ ) {
 		++xid_;
 	}
 	return ((Header)(xid_)) << XID_SHIFT;
@@ -141,18 +314,65 @@ JtagDriverAxisToJtag::getErr(Header   x)
 unsigned long
 JtagDriverAxisToJtag::getLen(Header x)
 {
-	if ( getCmd(x) != CMD_S ) {
+	if ( getCmd(x) != CMD_S && getCmd(x) != CMD_Z && getCmd(x) != CMD_C ) {
 		throw ProtoErr("Cannot extract length from non-shift command header");
 	}
 	return ((x & LEN_MASK) >> LEN_SHIFT) + 1;
 }
 
+unsigned long
+JtagDriverAxisToJtag::getMsgLen(uint8_t *buf, unsigned wsz, unsigned *phsz)
+{
+Header        x   = getHdr( buf );
+unsigned long len = getLen( x );
+unsigned      hsz = wsz;
+
+	if ( getVrs( x ) == PVER2 && (x & LEN_MASK) == LEN_MASK ) {
+		len = (unsigned long)getw32( buf + wsz ) + 1;
+		hsz = 2*wsz;
+	}
+	if ( phsz ) {
+		*phsz = hsz;
+	}
+	return len;
+}
+
 unsigned
 JtagDriverAxisToJtag::getVrs(Header x)
 {
 	return (x & VRS_MASK);
 }
 
+bool
+JtagDriverAxisToJtag::isClkAck(Header x)
+{
+	return CMD_C == getCmd( x ) && CLK_ACK == ( x & LEN_MASK );
+}
+
+bool
+JtagDriverAxisToJtag::isSegFrame(Header x)
+{
+	return SEG_FRAME == (x & VRS_MASK);
+}
+
+JtagDriverAxisToJtag::Header
+JtagDriverAxisToJtag::mkSegHdr(Xid xid, unsigned num, Header flags)
+{
+	return SEG_FRAME | flags | (xid << SEG_XID_SHIFT) | ((num & (MAX_SEGS - 1)) << SEG_NUM_SHIFT);
+}
+
+JtagDriverAxisToJtag::Xid
+JtagDriverAxisToJtag::getSegXid(Header x)
+{
+	return (x >> SEG_XID_SHIFT) & 0xff;
+}
+
+unsigned
+JtagDriverAxisToJtag::getSegNum(Header x)
+{
+	return (x >> SEG_NUM_SHIFT) & (MAX_SEGS - 1);
+}
+
 const char *
 JtagDriverAxisToJtag::getMsg(unsigned e)
 {
@@ -171,14 +391,57 @@ JtagDriverAxisToJtag::getMsg(unsigned e)
 JtagDriverAxisToJtag::Header
 JtagDriverAxisToJtag::mkQuery()
 {
-	return PVERS | CMD_Q | XID_ANY;
+	return pvers_ | CMD_Q | XID_ANY;
 }
 
 JtagDriverAxisToJtag::Header
-JtagDriverAxisToJtag::mkShift(unsigned len)
+JtagDriverAxisToJtag::mkShift(unsigned len, Header cmd)
 {
 	len = len - 1;
-	return PVERS | CMD_S | newXid() | (len<<LEN_SHIFT);
+	return pvers_ | cmd | newXid() | (len<<LEN_SHIFT);
+}
+
+uint32_t
+JtagDriverAxisToJtag::hostCaps()
+{
+	return ( rleEna_ ? CAP_RLE : 0 ) | ( clkEna_ ? CAP_CLOCK : 0 ) | CAP_SETTCK | transportCaps();
+}
+
+uint32_t
+JtagDriverAxisToJtag::transportCaps()
+{
+	return 0;
+}
+
+uint32_t
+JtagDriverAxisToJtag::getTargetCaps()
+{
+	return tgtCaps_;
+}
+
+unsigned
+JtagDriverAxisToJtag::shiftHdrSize(unsigned long len)
+{
+	// the short header can't hold LEN_MASK as that marks the long one
+	return ( PVER2 == pvers_ && len > LEN_MASK ) ? 2*wordSize_ : wordSize_;
+}
+
+unsigned
+JtagDriverAxisToJtag::putShift(uint8_t *buf, unsigned long len, Header cmd)
+{
+	if ( shiftHdrSize( len ) > wordSize_ ) {
+		setHdr( buf, pvers_ | cmd | newXid() | LEN_MASK );
+		setHdr( buf + wordSize_, len - 1 );
+		return 2*wordSize_;
+	}
+	setHdr( buf, mkShift( len, cmd ) );
+	return wordSize_;
+}
+
+unsigned long
+JtagDriverAxisToJtag::maxShiftLen()
+{
+	return PVER2 == pvers_ ? 0xffffffffUL : LEN_MASK + 1;
 }
 
 unsigned
@@ -237,7 +500,7 @@ JtagDriverAxisToJtag::mkQueryReply(Header   protoVers, unsigned wordSize, unsign
 Header   rval;
 uint32_t periodEncoded = encPerNs( periodNs );
 
-	if ( protoVers != PVER0 ) {
+	if ( protoVers != PVER0 && protoVers != PVER1 && protoVers != PVER2 ) {
 		throw std::runtime_error("mkQueryReply: unsupported protocol version");
 	}
 	if ( wordSize > 16 ) {
@@ -258,172 +521,976 @@ uint32_t periodEncoded = encPerNs( periodNs );
 }
 
 
+JtagDriverAxisToJtag::Header
+JtagDriverAxisToJtag::getHdr(uint8_t *buf)
+{
+	return getw32( buf );
+}
+
+void
+JtagDriverAxisToJtag::setHdr(uint8_t *buf, Header   hdr)
+{
+unsigned empty =  getWordSize() - sizeof(hdr);
+
+	setw32(buf, hdr);
+	memset( buf + sizeof(hdr), 0, empty );
+}
+
+void
+JtagDriverAxisToJtag::init()
+{
+MtxLock lck( &xferMtx_ );
+
+	// obtain server parameters
+	doQuery();
+}
+
+void
+JtagDriverAxisToJtag::chkErr(Header hdr)
+{
+unsigned e;
+
+	if ( (e = getErr( hdr )) ) {
+		char        errb[256];
+		const char *msg = getMsg( e );
+		int         pos;
+		pos = snprintf(errb, sizeof(errb), "Got error response from server -- ");
+		if ( msg ) {
+			snprintf(errb + pos, sizeof(errb) - pos, "%s", msg);
+		} else {
+			snprintf(errb + pos, sizeof(errb) - pos, "error %d", e);
+		}
+
+		throw ProtoErr(errb);
+	}
+}
+
+bool
+JtagDriverAxisToJtag::canPipeline()
+{
+	return false;
+}
+
+void
+JtagDriverAxisToJtag::submit(uint8_t *, unsigned)
+{
+	throw std::runtime_error("Internal Error: driver does not support pipelining");
+}
+
+int
+JtagDriverAxisToJtag::complete(uint8_t *, unsigned, uint8_t *, unsigned)
+{
+	throw std::runtime_error("Internal Error: driver does not support pipelining");
+}
+
+unsigned long
+JtagDriverAxisToJtag::getMaxMsgVectorSize()
+{
+	return getMaxVectorSize();
+}
+
+unsigned
+JtagDriverAxisToJtag::getQueueDepth()
+{
+	return 1;
+}
+
+unsigned
+JtagDriverAxisToJtag::getWindow()
+{
+	return window_;
+}
+
+void
+JtagDriverAxisToJtag::setMaxWindow(unsigned maxWindow)
+{
+	if ( 0 == maxWindow ) {
+		maxWindow = 1;
+	} else if ( maxWindow > MAX_WINDOW ) {
+		maxWindow = MAX_WINDOW;
+	}
+	maxWindow_ = maxWindow;
+}
+
+void
+JtagDriverAxisToJtag::setMaxRetries(unsigned maxRetry)
+{
+	maxRetry_ = maxRetry;
+}
+
+void
+JtagDriverAxisToJtag::setMaxVersion(unsigned vers)
+{
+	if ( vers > (PVERS >> 30) ) {
+		vers = PVERS >> 30;
+	}
+	maxVers_ = ((Header)vers) << 30;
+}
+
+void
+JtagDriverAxisToJtag::setCompression(bool enable)
+{
+	rleEna_ = enable;
+}
+
+void
+JtagDriverAxisToJtag::setClockRun(unsigned long minCycles)
+{
+	clkEna_ = ( CLK_RUN_OFF != minCycles );
+	clkMin_ = ( CLK_RUN_OFF == minCycles ? 0 : minCycles );
+}
+
+bool
+JtagDriverAxisToJtag::canXferv()
+{
+	return false;
+}
+
+int
+JtagDriverAxisToJtag::xferv( const struct iovec *iov, unsigned iovcnt, uint8_t *hdbuf, unsigned hsize, uint8_t *rxb, unsigned size )
+{
+unsigned i;
+unsigned long len;
+uint8_t *wp;
+
+	if ( 1 == iovcnt ) {
+		return xfer( (uint8_t*)iov[0].iov_base, iov[0].iov_len, hdbuf, hsize, rxb, size );
+	}
+
+	for ( i = 0, len = 0; i < iovcnt; i++ ) {
+		len += iov[i].iov_len;
+	}
+	if ( gthBuf_.size() < len ) {
+		gthBuf_.resize( len );
+	}
+	for ( i = 0, wp = &gthBuf_[0]; i < iovcnt; i++ ) {
+		memcpy( wp, iov[i].iov_base, iov[i].iov_len );
+		wp += iov[i].iov_len;
+	}
+	return xfer( &gthBuf_[0], len, hdbuf, hsize, rxb, size );
+}
+
+int
+JtagDriverAxisToJtag::xferRel( uint8_t *txb, unsigned txBytes, Header *phdr, uint8_t *rxb, unsigned sizeBytes )
+{
+struct iovec iov;
+
+	iov.iov_base = txb;
+	iov.iov_len  = txBytes;
+	return xferRelv( &iov, 1, phdr, rxb, sizeBytes );
+}
+
+int
+JtagDriverAxisToJtag::xferRelv( const struct iovec *iov, unsigned iovcnt, Header *phdr, uint8_t *rxb, unsigned sizeBytes )
+{
+Header   txh = getHdr( (uint8_t*)iov[0].iov_base );
+Xid      xid = getXid( txh );
+// XID_ANY is a valid shift XID in version 1; only a query accepts any reply
+bool     any = ( XID_ANY == xid && CMD_Q == getCmd( txh ) );
+unsigned attempt;
+int      got;
+
+	for (attempt = 0; attempt <= retry_; attempt++ ) {
+		Header   hdr;
+		try {
+			if ( ! hooked_ ) {
+				got = xferv( iov, iovcnt, &hdBuf_[0], wordSize_, rxb, sizeBytes );
+			} else {
+				got = xfervHooked( txh, iov, iovcnt, rxb, sizeBytes );
+			}
+			hdr = getHdr( &hdBuf_[0] );
+			chkErr( hdr );
+			if ( any || xid == getXid( hdr ) ) {
+				if ( phdr ) {
+					*phdr = hdr;
+				}
+				return decodeReply( hdr, rxb, sizeBytes, rxb, got );
+			}
+		} catch (TimeoutErr) {
+		}
+	}
+
+	throw TimeoutErr();
+}
+
+bool
+JtagDriverAxisToJtag::addXferHook(JtagXferHook *hook)
+{
+MtxLock lck( &xferMtx_ );
+
+	hooks_.push_back( hook );
+	hooked_ = true;
+	return true;
+}
+
+bool
+JtagDriverAxisToJtag::hookSend(Header hdr, unsigned len, struct timespec *then)
+{
+unsigned i;
+bool     send = true;
+
+	for ( i = 0; i < hooks_.size(); i++ ) {
+		if ( ! hooks_[i]->xferSend( hdr, len ) ) {
+			send = false;
+		}
+	}
+	clock_gettime( CLOCK_MONOTONIC, then );
+	// without replay memory a dropped message can't be recovered
+	return send || 0 == memDepth_;
+}
+
+void
+JtagDriverAxisToJtag::hookDone(Header hdr, Header rplHdr, int got, const struct timespec *then)
+{
+struct timespec now;
+unsigned long   ns;
+unsigned        i;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	ns = (now.tv_sec - then->tv_sec)*1000000000UL + now.tv_nsec - then->tv_nsec;
+	for ( i = 0; i < hooks_.size(); i++ ) {
+		hooks_[i]->xferDone( hdr, rplHdr, got, ns );
+	}
+}
+
+int
+JtagDriverAxisToJtag::xfervHooked(Header hdr, const struct iovec *iov, unsigned iovcnt, uint8_t *rxb, unsigned size)
+{
+struct timespec then;
+unsigned        len = 0;
+unsigned        i;
+int             got;
+
+	for ( i = 0; i < iovcnt; i++ ) {
+		len += iov[i].iov_len;
+	}
+	if ( ! hookSend( hdr, len, &then ) ) {
+		hookDone( hdr, 0, -1, &then );
+		throw TimeoutErr();
+	}
+	try {
+		got = xferv( iov, iovcnt, &hdBuf_[0], wordSize_, rxb, size );
+	} catch ( TimeoutErr & ) {
+		hookDone( hdr, 0, -1, &then );
+		throw;
+	}
+	hookDone( hdr, getHdr( &hdBuf_[0] ), got, &then );
+	return got;
+}
+
+unsigned long
+JtagDriverAxisToJtag::query()
+{
+MtxLock lck( &xferMtx_ );
+
+	if ( ! cacheValid_ ) {
+		doQuery();
+	}
+
+	// with pipelining we handle 'window_' target buffers' worth
+	return memDepth_ * wordSize_ * window_;
+}
+
+unsigned
+JtagDriverAxisToJtag::fmtQuery(uint8_t *buf)
+{
+unsigned qsz, wsz;
+
+	setHdr ( buf, mkQuery() );
+	wsz = getWordSize();
+	qsz = wsz;
+	if ( PVER2 == pvers_ && wszKnown_ ) {
+		// our capabilities and the TCK period follow in the next
+		// two words (we must know the word size of the target to
+		// lay them out).
+		memset( buf + qsz, 0, 2*wsz );
+		setw32( buf +   wsz, hostCaps() );
+		setw32( buf + 2*wsz, tckReqNs_  );
+		qsz += 2*wsz;
+	}
+	return qsz;
+}
+
+// caller must hold xferMtx_
+unsigned long
+JtagDriverAxisToJtag::doQuery()
+{
+Header   hdr;
+unsigned siz, qsz;
+uint8_t  cap[3*16];
+uint32_t dpt, per;
+int      got;
+Header   vers  = pvers_;
+bool     valid = cacheValid_;
+
+	cacheValid_ = false;
+
+	// try the highest version first; the capabilities don't depend
+	// on the transport (only the window does).
+	pvers_      = maxVers_;
+
+	try {
+		while ( 1 ) {
+			qsz = fmtQuery( &txBuf_[0] );
+
+			if ( getDebug() > 1 ) {
+				fprintf(stderr, "query (version %d)\n", getVrs( pvers_ ) >> 30);
+			}
+
+			try {
+				got = xferRel( &txBuf_[0], qsz, &hdr, cap, sizeof(cap) );
+				break;
+			} catch ( ProtoErr &e ) {
+				hdr = getHdr( &hdBuf_[0] );
+				if ( PVER0 == pvers_ || ERR_BAD_VERSION != getErr( hdr ) ) {
+					throw;
+				}
+				// older target; it should tell us its version but
+				// version 0 firmware might not
+				pvers_ = getVrs( hdr ) < pvers_ ? getVrs( hdr ) : pvers_ - PVER1;
+			}
+		}
+	} catch ( std::runtime_error & ) {
+		// a failed (e.g., timed out) query keeps what the
+		// previous one negotiated
+		pvers_      = vers;
+		cacheValid_ = valid;
+		throw;
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &lastXfer_ );
+
+	wordSize_ = wordSize( hdr );
+	ilv_      = ilvSelect( wordSize_ );
+	fmt_      = fmtSelect( wordSize_ );
+	if ( wordSize_  < sizeof(hdr) ) {
+		throw ProtoErr("Received invalid word size");
+	}
+	if ( ! wszKnown_ ) {
+		wszKnown_ = true;
+		if ( PVER2 == pvers_ ) {
+			// now we can lay out our capabilities; ask again
+			return doQuery();
+		}
+	}
+	memDepth_ = memDepth( hdr );
+	// the header field may be too narrow
+	if ( PVER2 == pvers_ && got >= (int)(wordSize_ + sizeof(dpt)) ) {
+		if ( (dpt = getw32( cap + wordSize_ )) ) {
+			memDepth_ = dpt;
+		}
+	}
+	periodNs_ = cvtPerNs( hdr );
+	// more accurate than the header field
+	if ( PVER2 == pvers_ && got >= (int)(2*wordSize_ + sizeof(per)) ) {
+		if ( (per = getw32( cap + 2*wordSize_ )) ) {
+			periodNs_ = per;
+		}
+	}
+
+	if ( getDebug() > 1 ) {
+		fprintf(stderr, "query result: wordSize %d, memDepth %d, period %ldns\n", wordSize_, memDepth_, (unsigned long)periodNs_);
+	}
+
+	if ( 0 == memDepth_ )
+		retry_ = 0;
+	else
+		retry_ = maxRetry_;
+
+	nBufs_  = 1;
+	rle_    = false;
+	clk_    = false;
+	tck_    = false;
+	tgtCaps_ = 0;
+	if ( pvers_ >= PVER1 && got >= 4 ) {
+		tgtCaps_ = getw32( cap ) & ~CAP_NBUFS_MASK;
+		if ( getw32( cap ) & CAP_NBUFS_MASK ) {
+			nBufs_ = getw32( cap ) & CAP_NBUFS_MASK;
+		}
+		rle_ = rleEna_ && ( getw32( cap ) & CAP_RLE );
+		clk_ = clkEna_ && ( getw32( cap ) & CAP_CLOCK );
+		tck_ = PVER2 == pvers_ && ( getw32( cap ) & CAP_SETTCK );
+		tapState_ = TAP_U0;
+	}
+
+	// pipelining needs replay memory (retransmission) and a transport
+	// which supports it; a reliable transport may queue messages instead.
+	window_ = 1;
+	if ( memDepth_ > 0 && canPipeline() ) {
+		window_ = nBufs_ < maxWindow_ ? nBufs_ : maxWindow_;
+	} else if ( getQueueDepth() > 1 ) {
+		window_ = getQueueDepth() < maxWindow_ ? getQueueDepth() : maxWindow_;
+	}
+
+	if ( (siz = (2*memDepth_ + 2) * wordSize_) > bufSz_ ) {
+		bufSz_ = siz;
+		txBuf_.reserve( bufSz_ );
+	}
+
+	cacheValid_ = true;
+
+	return memDepth_ * wordSize_;
+}
+
+bool
+JtagDriverAxisToJtag::probe()
+{
+MtxLock         lck( &xferMtx_ );
+struct timespec now;
+unsigned        oldWordSize = wordSize_;
+unsigned        oldMemDepth = memDepth_;
+uint32_t        oldPeriodNs = periodNs_;
+long            idleMs;
+
+	if ( ! probeRun_ ) {
+		return false;
+	}
+
+	// don't interfere with an active session
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	idleMs = (now.tv_sec - lastXfer_.tv_sec)*1000 + (now.tv_nsec - lastXfer_.tv_nsec)/1000000;
+	if ( idleMs < (long)probeMs_ ) {
+		return true;
+	}
+
+	try {
+		doQuery();
+	} catch ( std::runtime_error &e ) {
+		if ( ! tgtLost_ ) {
+			fprintf(stderr, "WARNING: health probe -- target not responding (%s)\n", e.what());
+			tgtLost_ = true;
+		}
+		return true;
+	}
+
+	if ( tgtLost_ || oldWordSize != wordSize_ || oldMemDepth != memDepth_ || oldPeriodNs != periodNs_ ) {
+		// we cannot tell for sure but most likely the FW was reset/reloaded
+		tgtResets_++;
+		fprintf(stderr, "WARNING: health probe -- target %s; assuming a firmware reset\n",
+		        tgtLost_ ? "is responding again" : "parameters changed");
+		tgtLost_ = false;
+	}
+
+	return true;
+}
+
+void *
+JtagDriverAxisToJtag::probeThread(void *arg)
+{
+JtagDriverAxisToJtag *me = (JtagDriverAxisToJtag*)arg;
+struct timespec       per;
+
+	per.tv_sec  =  me->probeMs_ / 1000;
+	per.tv_nsec = (me->probeMs_ % 1000) * 1000000;
+
+	do {
+		nanosleep( &per, 0 );
+	} while ( me->probe() );
+
+	return 0;
+}
+
+void
+JtagDriverAxisToJtag::setHealthProbe(unsigned periodMs)
+{
+bool running;
+
+	{
+	MtxLock lck( &xferMtx_ );
+		running   = probeRun_;
+		probeRun_ = false;
+	}
+
+	if ( running ) {
+		pthread_join( probeT_, 0 );
+	}
+
+	if ( 0 == (probeMs_ = periodMs) ) {
+		return;
+	}
+
+	probeRun_ = true;
+	if ( pthread_create( &probeT_, 0, probeThread, this ) ) {
+		probeRun_ = false;
+		throw SysErr("Unable to launch health probe thread");
+	}
+}
+
+uint32_t
+JtagDriverAxisToJtag::getPeriodNs()
+{
+	return periodNs_;
+}
+
 uint32_t
-JtagDriverAxisToJtag::getw32(uint8_t *buf)
+JtagDriverAxisToJtag::setPeriodNs(uint32_t requestedPeriod)
 {
-	uint32_t w;
-	memcpy( &w, buf, sizeof(w) );
-	if ( ! isLE() ) {
-		w = __builtin_bswap32( w );
+MtxLock  lck( &xferMtx_ );
+uint32_t currentPeriod = getPeriodNs();
+uint32_t currentReq    = tckReqNs_;
+
+	if ( 0 == requestedPeriod )
+		return currentPeriod;
+
+	if ( tck_ ) {
+		// the target picks the closest period it supports
+		// (and tells us with the query reply)
+		tckReqNs_ = requestedPeriod;
+		try {
+			doQuery();
+		} catch ( TimeoutErr & ) {
+			// the tool only gets a period back; keep the old one
+			// (a later query asks for it again)
+			tckReqNs_ = currentReq;
+			if ( getDebug() > 0 ) {
+				fprintf(stderr, "settck: no reply from target; keeping TCK period\n");
+			}
+			return currentPeriod;
+		}
+		return getPeriodNs();
 	}
-	return w;
+
+	return UNKNOWN_PERIOD == currentPeriod ? requestedPeriod : currentPeriod;
 }
 
-JtagDriverAxisToJtag::Header
-JtagDriverAxisToJtag::getHdr(uint8_t *buf)
+static void prwrds(FILE *f, uint8_t *tms, uint8_t *tdi, int wsz, int nbits)
 {
-	return getw32( buf );
+int i;
+int nbytes = (nbits + 7)/8;
+const char *pre = tdi ? "TMS" : "TDO";
+
+	fprintf(f, "( %s => x\"", pre);
+	for ( i = wsz; i > nbytes; i-- ) {
+		fprintf(f, "00");
+	}
+	while ( --i >= 0 ) {
+		fprintf(f, "%02x", tms[i]);
+	}
+	if ( tdi ) {
+		fprintf(stderr, "\", TDI => x\"");
+		for ( i = wsz; i > nbytes; i-- ) {
+			fprintf(f, "00");
+		}
+		while ( --i >= 0 ) {
+			fprintf(f, "%02x", tdi[i]);
+		}
+	}
+	fprintf(stderr, "\", nbits => %d),\n", nbits);
+}
+
+template <unsigned WSZ>
+unsigned
+JtagDriverAxisToJtag::fmtShiftW(uint8_t *buf, unsigned wsz, unsigned hsz, unsigned long bytes, const uint8_t *tms, const uint8_t *tdi, IlvFunc ilv)
+{
+// with a fixed word size this is constant-folded
+const unsigned w = WSZ ? WSZ : wsz;
+
+	// store sequence of TMS/TDI pairs past the header
+	ilv( buf + hsz, tms, tdi, bytes, w );
+
+	return hsz + 2*((bytes + w - 1)/w)*w;
+}
+
+JtagDriverAxisToJtag::FmtFunc
+JtagDriverAxisToJtag::fmtSelect(unsigned wsz)
+{
+	switch ( wsz ) {
+		case  4: return fmtShiftW< 4>;
+		case  8: return fmtShiftW< 8>;
+		case 16: return fmtShiftW<16>;
+		default: break;
+	}
+	return fmtShiftW<0>;
+}
+
+unsigned
+JtagDriverAxisToJtag::fmtShift(uint8_t *buf, unsigned long bits, uint8_t *tms, uint8_t *tdi)
+{
+	return fmt_( buf, wordSize_, putShift( buf, bits ), (bits + 7)/8, tms, tdi, ilv_ );
+}
+
+unsigned
+JtagDriverAxisToJtag::fmtShiftZ(uint8_t *buf, unsigned long bits, uint8_t *tms, uint8_t *tdi, unsigned long maxBytes)
+{
+unsigned      wsz   = wordSize_;
+unsigned      hsz   = shiftHdrSize( bits );
+unsigned long bytes = (bits + 7)/8;
+unsigned long plain = hsz + 2*((bytes + wsz - 1)/wsz)*wsz;
+unsigned long l1, l2, len;
+
+	// not worth it unless we save at least a word
+	if ( maxBytes > plain - wsz ) {
+		maxBytes = plain - wsz;
+	}
+	if ( maxBytes <= hsz ) {
+		return 0;
+	}
+	if ( ! (l1 = rleEncode( buf + hsz, maxBytes - hsz, tms, bytes )) ) {
+		return 0;
+	}
+	if ( ! (l2 = rleEncode( buf + hsz + l1, maxBytes - hsz - l1, tdi, bytes )) ) {
+		return 0;
+	}
+	len = hsz + ((l1 + l2 + wsz - 1)/wsz)*wsz;
+	if ( len > maxBytes ) {
+		return 0;
+	}
+	memset( buf + hsz + l1 + l2, 0, len - hsz - l1 - l2 );
+
+	putShift( buf, bits, CMD_Z );
+
+	nRleTx_++;
+
+	return len;
+}
+
+int
+JtagDriverAxisToJtag::decodeReply(Header hdr, uint8_t *dst, unsigned long bytes, uint8_t *src, int got)
+{
+	if ( getCmd( hdr ) != CMD_Z ) {
+		if ( dst != src ) {
+			if ( (unsigned long)got > bytes ) {
+				got = bytes;
+			}
+			memmove( dst, src, got );
+		}
+		return got;
+	}
+
+	// src and dst may overlap
+	if ( rleBuf_.size() < (unsigned long)got ) {
+		rleBuf_.resize( got );
+	}
+	memcpy( &rleBuf_[0], src, got );
+	if ( rleDecode( dst, bytes, &rleBuf_[0], got ) < 0 ) {
+		throw ProtoErr("Malformed compressed reply");
+	}
+	nRleRx_++;
+
+	return bytes;
+}
+
+unsigned
+JtagDriverAxisToJtag::fmtShiftv(uint8_t *hdr, unsigned long bits, uint8_t *tms, uint8_t *tdi)
+{
+static const uint8_t zeros[16] = { 0 };
+unsigned      wsz = wordSize_;
+
+unsigned long bytesCeil      = (bits  +   8 - 1 )/8;
+unsigned      wholeWordBytes = (bytesCeil / wsz) * wsz;
+unsigned      bytesLeft      = bytesCeil - wholeWordBytes;
+unsigned      n              = 1 + 2*((bytesCeil + wsz - 1)/wsz) + (bytesLeft ? 2 : 0);
+unsigned      idx;
+struct iovec *v;
+
+	if ( n > IOV_MAX ) {
+		return 0;
+	}
+
+	if ( iov_.size() < n ) {
+		iov_.resize( n );
+	}
+
+	v = &iov_[0];
+	v->iov_base = hdr;
+	v->iov_len  = putShift( hdr, bits );
+	v++;
+
+	// sequence of TMS/TDI pairs; word-by-word
+	for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
+		v->iov_base = tms + idx;
+		v->iov_len  = wsz;
+		v++;
+		v->iov_base = tdi + idx;
+		v->iov_len  = wsz;
+		v++;
+	}
+	if ( bytesLeft ) {
+		// pad the last words
+		v->iov_base = tms + idx;
+		v->iov_len  = bytesLeft;
+		v++;
+		v->iov_base = (void*)zeros;
+		v->iov_len  = wsz - bytesLeft;
+		v++;
+		v->iov_base = tdi + idx;
+		v->iov_len  = bytesLeft;
+		v++;
+		v->iov_base = (void*)zeros;
+		v->iov_len  = wsz - bytesLeft;
+		v++;
+	}
+
+	return v - &iov_[0];
 }
 
-void
-JtagDriverAxisToJtag::setw32(uint8_t *buf, uint32_t w, unsigned l)
+unsigned long
+JtagDriverAxisToJtag::rleMaxVectorSize()
 {
-	if ( ! isLE() ) {
-		w = __builtin_bswap32( w );
+unsigned long l = 2*getMaxMsgVectorSize();
+
+	// the reply may not compress; it must still fit in
+	// a message and in the target memory
+	if ( memDepth_ && l > memDepth_ * wordSize_ ) {
+		l = memDepth_ * wordSize_;
 	}
-	memcpy( buf, &w, l >= sizeof(w) ? sizeof(w) : l );
+	return (l / wordSize_) * wordSize_;
 }
 
 void
-JtagDriverAxisToJtag::setHdr(uint8_t *buf, Header   hdr)
+JtagDriverAxisToJtag::sendVectorsPipelined(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
 {
-unsigned empty =  getWordSize() - sizeof(hdr);
+unsigned      wsz     = wordSize_;
+unsigned long bytes   = (bits + 7)/8;
+unsigned long chunk   = getMaxMsgVectorSize();
+unsigned long zChunk  = rle_ ? rleMaxVectorSize() : 0;
+unsigned long msgSz;
+unsigned long base, nxt, k, off, nxtOff, n;
+unsigned      attempt = 0;
+unsigned      nAcked  = 0;
+unsigned      slot;
+Xid           xids[MAX_WINDOW];
+unsigned      lens[MAX_WINDOW];
+unsigned long offs[MAX_WINDOW];
+unsigned long vlen[MAX_WINDOW];
+bool          acks[MAX_WINDOW];
+struct timespec sent[MAX_WINDOW];
+Header        hdr;
+int           got;
+uint8_t      *rxp;
+
+	// messages must hold whole words and fit in the target memory
+	if ( memDepth_ && chunk > memDepth_ * wsz ) {
+		chunk = memDepth_ * wsz;
+	}
+	chunk   = (chunk / wsz) * wsz;
+	msgSz   = shiftHdrSize( 8*chunk ) + 2*chunk;
 
-	setw32(buf, hdr);
-	memset( buf + sizeof(hdr), 0, empty );
-}
+	if ( winBuf_.size() < window_ * msgSz ) {
+		winBuf_.resize( window_ * msgSz );
+	}
 
-void
-JtagDriverAxisToJtag::init()
-{
-	// obtain server parameters
-	query();
-}
+	base = nxt = 0;
+	nxtOff     = 0;
 
-int
-JtagDriverAxisToJtag::xferRel( uint8_t *txb, unsigned txBytes, Header *phdr, uint8_t *rxb, unsigned sizeBytes )
-{
-Xid      xid = getXid( getHdr( txb ) );
-unsigned attempt;
-unsigned e;
-int      got;
+	while ( nxtOff < bytes || base < nxt ) {
+
+		// fill the window; a compressed message may carry
+		// a longer vector than a plain one.
+		while ( nxtOff < bytes && nxt - base < window_ ) {
+			slot       = nxt % window_;
+			lens[slot] = 0;
+			if ( zChunk ) {
+				n          = bytes - nxtOff < zChunk ? bytes - nxtOff : zChunk;
+				lens[slot] = fmtShiftZ( &winBuf_[slot*msgSz], nxtOff + n == bytes ? bits - 8*nxtOff : 8*n, tms + nxtOff, tdi + nxtOff, msgSz );
+			}
+			if ( ! lens[slot] ) {
+				n          = bytes - nxtOff < chunk ? bytes - nxtOff : chunk;
+				lens[slot] = fmtShift( &winBuf_[slot*msgSz], nxtOff + n == bytes ? bits - 8*nxtOff : 8*n, tms + nxtOff, tdi + nxtOff );
+			}
+			offs[slot] = nxtOff;
+			vlen[slot] = n;
+			xids[slot] = getXid( getHdr( &winBuf_[slot*msgSz] ) );
+			acks[slot] = false;
+			if ( ! hooked_ || hookSend( getHdr( &winBuf_[slot*msgSz] ), lens[slot], &sent[slot] ) ) {
+				submit( &winBuf_[slot*msgSz], lens[slot] );
+			}
+			nxtOff    += n;
+			nxt++;
+		}
+
+		// replies normally arrive in order; receive into the oldest
+		// outstanding slot of the TDO vector and move if necessary.
+		// If a later one was acknowledged already then a reply might
+		// overwrite it; use a separate buffer.
+		off = offs[base % window_];
+		if ( nAcked ) {
+			if ( rplBuf_.size() < msgSz ) {
+				rplBuf_.resize( msgSz );
+			}
+			rxp = &rplBuf_[0];
+			n   = msgSz;
+		} else {
+			rxp = tdo + off;
+			n   = bytes - off;
+		}
 
-	for (attempt = 0; attempt <= retry_; attempt++ ) {
-		Header   hdr;
 		try {
-			got = xfer( txb, txBytes, &hdBuf_[0], getWordSize(), rxb, sizeBytes );
-			hdr = getHdr( &hdBuf_[0] );
-			if ( (e = getErr( hdr )) ) {
-				char        errb[256];
-                const char *msg = getMsg( e );
-                int         pos; 
-				pos = snprintf(errb, sizeof(errb), "Got error response from server -- ");
-				if ( msg ) {
-					snprintf(errb + pos, sizeof(errb) - pos, "%s", msg);
-				} else {
-					snprintf(errb + pos, sizeof(errb) - pos, "error %d", e);
-				}
-                
-				throw ProtoErr(errb);
+			got = complete( &hdBuf_[0], wsz, rxp, n );
+		} catch ( TimeoutErr & ) {
+			if ( hooked_ ) {
+				slot = base % window_;
+				hookDone( getHdr( &winBuf_[slot*msgSz] ), 0, -1, &sent[slot] );
 			}
-			if ( xid == XID_ANY || xid == getXid( hdr ) ) {
-				if ( phdr ) {
-					*phdr = hdr;
+			if ( ++attempt > retry_ ) {
+				throw;
+			}
+			// go back; the target replays what it already executed
+			// and drops everything following a lost message.
+			for ( k = base; k < nxt; k++ ) {
+				slot = k % window_;
+				if ( ! acks[slot] ) {
+					if ( ! hooked_ || hookSend( getHdr( &winBuf_[slot*msgSz] ), lens[slot], &sent[slot] ) ) {
+						submit( &winBuf_[slot*msgSz], lens[slot] );
+					}
+					nRetrans_++;
 				}
-				return got;
 			}
-		} catch (TimeoutErr) {
+			continue;
 		}
-	}
 
-	throw TimeoutErr();
-}
+		hdr = getHdr( &hdBuf_[0] );
+		if ( getErr( hdr ) && 0 == memDepth_ ) {
+			// a reliable transport still holds the replies to the
+			// messages queued behind this one; collect them so the
+			// next transfer doesn't pick them up.
+			if ( rplBuf_.size() < msgSz ) {
+				rplBuf_.resize( msgSz );
+			}
+			while ( ++base < nxt ) {
+				complete( &hdBuf_[0], wsz, &rplBuf_[0], msgSz );
+			}
+		}
+		chkErr( hdr );
 
-unsigned long
-JtagDriverAxisToJtag::query()
-{
-Header   hdr;
-unsigned siz;
+		for ( k = base; k < nxt; k++ ) {
+			slot = k % window_;
+			if ( ! acks[slot] && xids[slot] == getXid( hdr ) ) {
+				break;
+			}
+		}
 
-	setHdr ( &txBuf_[0], mkQuery() );
+		if ( k == nxt ) {
+			// stale or duplicate
+			continue;
+		}
 
-	if ( getDebug() > 1 ) {
-		fprintf(stderr, "query\n");
-	}
+		if ( hooked_ ) {
+			hookDone( getHdr( &winBuf_[slot*msgSz] ), hdr, got, &sent[slot] );
+		}
 
-	xferRel( &txBuf_[0], getWordSize(), &hdr, 0, 0 );
+		decodeReply( hdr, tdo + offs[slot], vlen[slot], rxp, got );
 
-	wordSize_ = wordSize( hdr );
-	if ( wordSize_  < sizeof(hdr) ) {
-		throw ProtoErr("Received invalid word size");
-	}
-	memDepth_ = memDepth( hdr );
-	periodNs_ = cvtPerNs( hdr );
+		acks[slot] = true;
+		nAcked++;
 
-	if ( getDebug() > 1 ) {
-		fprintf(stderr, "query result: wordSize %d, memDepth %d, period %ldns\n", wordSize_, memDepth_, (unsigned long)periodNs_);
+		while ( base < nxt && acks[base % window_] ) {
+			base++;
+			nAcked--;
+			attempt = 0;
+		}
 	}
+}
 
-	if ( 0 == memDepth_ )
-		retry_ = 0;
-	else
-		retry_ = 5;
-
-	if ( (siz = (2*memDepth_ + 1) * wordSize_) > bufSz_ ) {
-		bufSz_ = siz;
-		txBuf_.reserve( bufSz_ );
+unsigned long
+JtagDriverAxisToJtag::findIdleRun(unsigned long bits, const uint8_t *tms, const uint8_t *tdi, unsigned long off, unsigned long minBytes, unsigned long *plen)
+{
+unsigned      wsz   = wordSize_;
+unsigned long whole = (bits / (8*wsz)) * wsz;
+unsigned long e, i;
+unsigned      b;
+
+	while ( off < whole ) {
+		if ( tapIdle( tapState_, tms[off] ) && constWord( tms + off, wsz ) && constWord( tdi + off, wsz ) ) {
+			for ( e = off + wsz; e < whole && 0 == memcmp( tms + e, tms + off, wsz ) && 0 == memcmp( tdi + e, tdi + off, wsz ); e += wsz )
+				;
+			// the state does not change during the run
+			if ( e - off >= minBytes ) {
+				*plen = e - off;
+				return off;
+			}
+			off = e;
+			continue;
+		}
+		for ( i = 0; i < wsz; i++ ) {
+			tapState_ = tapByte( tapState_, tms[off + i] );
+		}
+		off += wsz;
 	}
 
-	return memDepth_ * wordSize_;
+	// no run; track the state to the end of the vector
+	for ( ; off < bits/8; off++ ) {
+		tapState_ = tapByte( tapState_, tms[off] );
+	}
+	for ( b = 0; b < bits % 8; b++ ) {
+		tapState_ = tapNxt[tapState_][ (tms[off] >> b) & 1 ];
+	}
+	*plen = 0;
+	return (bits + 7)/8;
 }
 
-
-uint32_t
-JtagDriverAxisToJtag::getPeriodNs()
+void
+JtagDriverAxisToJtag::sendClock(unsigned long cycles, unsigned tms, unsigned tdi)
 {
-	return periodNs_;
+unsigned      wsz = wordSize_;
+// whole words, within the length field
+unsigned long max = ( maxShiftLen() / (8*wsz)) * 8*wsz;
+unsigned long n;
+unsigned      hsz;
+Header        hdr;
+char          msg[64];
+
+	while ( cycles > 0 ) {
+		n   = cycles > max ? max : cycles;
+		hsz = putShift( &txBuf_[0], n, CMD_C );
+		memset( &txBuf_[hsz], 0, wsz );
+		txBuf_[hsz] = (tms ? 1 : 0) | (tdi ? 2 : 0);
+		xferRel( &txBuf_[0], hsz + wsz, &hdr, 0, 0 );
+		if ( ! isClkAck( hdr ) ) {
+			// an error reply with code 0 or anything else
+			snprintf( msg, sizeof(msg), "Unexpected reply to clock command: 0x%08x", hdr );
+			throw ProtoErr( msg );
+		}
+		nClkCmds_++;
+		cycles -= n;
+	}
 }
 
-uint32_t
-JtagDriverAxisToJtag::setPeriodNs(uint32_t requestedPeriod)
+void
+JtagDriverAxisToJtag::sendSegment(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
 {
-uint32_t currentPeriod = getPeriodNs();
-
-	if ( 0 == requestedPeriod )
-		return currentPeriod;
+unsigned      wsz            = wordSize_;
+unsigned long bytesCeil      = (bits  +   8 - 1 )/8;
+unsigned      wordCeilBytes  = ((bytesCeil + wsz - 1)/wsz) * wsz;
+unsigned      bytesTot       = shiftHdrSize( bits ) + 2*wordCeilBytes;
+unsigned      iovcnt;
+unsigned      zLen           = 0;
+unsigned long msgMax;
+
+	if ( rle_ && bytesCeil <= rleMaxVectorSize() ) {
+		// maybe it fits in a single compressed message
+		msgMax = wsz + 2*getMaxMsgVectorSize();
+		if ( msgMax > txBuf_.capacity() ) {
+			txBuf_.reserve( msgMax );
+		}
+		zLen = fmtShiftZ( &txBuf_[0], bits, tms, tdi, msgMax );
+	}
 
-	return UNKNOWN_PERIOD == currentPeriod ? requestedPeriod : currentPeriod;
-}
+	if ( zLen ) {
+		xferRel( &txBuf_[0], zLen, 0, tdo, bytesCeil );
+	} else if ( window_ > 1 && ( bytesCeil > getMaxMsgVectorSize() || ( memDepth_ && bytesCeil > memDepth_ * wsz ) ) ) {
+		sendVectorsPipelined( bits, tms, tdi, tdo );
+	} else if ( canXferv() && (iovcnt = fmtShiftv( &txBuf_[0], bits, tms, tdi )) ) {
+		// TMS/TDI go out straight from the caller's buffers
+		xferRelv( &iov_[0], iovcnt, 0, tdo, bytesCeil );
+	} else {
+		// a target without memory (reliable transport) accepts vectors
+		// of any length; make sure they fit.
+		if ( bytesTot > txBuf_.capacity() ) {
+			txBuf_.reserve( bytesTot );
+		}
 
-static void prwrds(FILE *f, uint8_t *tms, uint8_t *tdi, int wsz, int nbits)
-{
-int i;
-int nbytes = (nbits + 7)/8;
-const char *pre = tdi ? "TMS" : "TDO";
+		fmtShift( &txBuf_[0], bits, tms, tdi );
 
-	fprintf(f, "( %s => x\"", pre);
-	for ( i = wsz; i > nbytes; i-- ) {
-		fprintf(f, "00");
-	}
-	while ( --i >= 0 ) {
-		fprintf(f, "%02x", tms[i]);
-	}
-	if ( tdi ) {
-		fprintf(stderr, "\", TDI => x\"");
-		for ( i = wsz; i > nbytes; i-- ) {
-			fprintf(f, "00");
-		}
-		while ( --i >= 0 ) {
-			fprintf(f, "%02x", tdi[i]);
-		}
+		xferRel( &txBuf_[0], bytesTot, 0, tdo, bytesCeil );
 	}
-	fprintf(stderr, "\", nbits => %d),\n", nbits);
 }
 
 void
 JtagDriverAxisToJtag::sendVectors(unsigned long bits, uint8_t *tms, uint8_t *tdi, uint8_t *tdo)
 {
-unsigned      wsz = getWordSize();
+MtxLock       lck( &xferMtx_ );
+unsigned      wsz = wordSize_;
 
 unsigned long bytesCeil      = (bits  +   8 - 1 )/8;
 unsigned      wholeWords     = bytesCeil / wsz;
@@ -433,32 +1500,12 @@ unsigned      bytesLeft      = bytesCeil - wholeWordBytes;
 unsigned      bytesTot       = wsz + 2*wordCeilBytes;
 int           lastbits       = bits - 8ULL*wholeWordBytes;
 unsigned      idx;
-int           bidx;
-
-uint8_t       *wp;
+unsigned long off, run, len, minBytes;
 
 	if ( getDebug() > 1 ) {
 		fprintf(stderr, "sendVec -- bits %ld, bytes %ld, bytesTot %d\n", bits, bytesCeil, bytesTot);
 	}
 
-	setHdr( &txBuf_[0], mkShift( bits ) );
-
-	// reformat
-
-	wp = &txBuf_[0] + wsz; // past header
-
-	// store sequence of TMS/TDI pairs; word-by-word
-	for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
-		memcpy( wp, & tms[idx], wsz );
-		wp  += wsz;
-		memcpy( wp, & tdi[idx], wsz );
-		wp  += wsz;
-	}
-	if ( bytesLeft ) {
-		memcpy( wp,       & tms[idx], bytesLeft );
-		memcpy( wp + wsz, & tdi[idx], bytesLeft );
-	}
-
 	if ( getDebug() > 1 ) {
 		for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
 			prwrds(stderr, tms + idx, tdi + idx, wsz, 8*wsz);
@@ -468,7 +1515,38 @@ uint8_t       *wp;
 		}
 	}
 
-	xferRel( &txBuf_[0], bytesTot, 0, tdo, bytesCeil );
+	if ( ! clk_ ) {
+		sendSegment( bits, tms, tdi, tdo );
+	} else {
+		// By default a run must be worth at least one full message
+		if ( ! (minBytes = (clkMin_ + 8*wsz - 1)/(8*wsz)*wsz) ) {
+			minBytes = getMaxMsgVectorSize();
+			if ( memDepth_ && minBytes > memDepth_ * wsz ) {
+				minBytes = memDepth_ * wsz;
+			}
+		}
+		try {
+			// clock idle runs (where TDO is undefined) by command; the
+			// vector is split at word boundaries around them.
+			for ( off = 0; off < bytesCeil; off = run + len ) {
+				run = findIdleRun( bits, tms, tdi, off, minBytes, &len );
+				if ( run > off ) {
+					sendSegment( run == bytesCeil ? bits - 8*off : 8*(run - off), tms + off, tdi + off, tdo + off );
+				}
+				if ( len ) {
+					sendClock( 8*len, tms[run] & 1, tdi[run] & 1 );
+					memset( tdo + run, 0, len );
+				}
+			}
+		} catch ( ... ) {
+			tapState_ = TAP_U0;
+			throw;
+		}
+	}
+
+	if ( probeRun_ ) {
+		clock_gettime( CLOCK_MONOTONIC, &lastXfer_ );
+	}
 
 	if ( getDebug() > 1 ) {
 		for ( idx=0; idx < wholeWordBytes; idx += wsz ) {
@@ -484,6 +1562,19 @@ uint8_t       *wp;
 	}
 }
 
+void
+JtagDriverAxisToJtag::getCaps(Caps *caps)
+{
+	JtagDriver::getCaps( caps );
+	caps->align_       = getWordSize();
+	caps->maxInFlight_ = getWindow();
+	caps->zeroCopy_    = canXferv();
+	if ( getWindow() > 1 ) {
+		// 'sendVectorsPipelined()' splits them
+		caps->chunk_   = CHUNK_ANY;
+	}
+}
+
 void
 JtagDriverAxisToJtag::dumpInfo(FILE *f)
 {
@@ -491,6 +1582,24 @@ JtagDriverAxisToJtag::dumpInfo(FILE *f)
 	fprintf(f, "Target Memory Depth (bytes) %d\n",  getWordSize() * getMemDepth());
 	fprintf(f, "Max. Vector Length  (bytes) %ld\n", getMaxVectorSize());
 	fprintf(f, "TCK Period             (ns) %ld\n", (unsigned long)getPeriodNs());
+	fprintf(f, "Protocol Version            %d\n",  getVrs( pvers_ ) >> 30);
+	if ( window_ > 1 && 0 == memDepth_ ) {
+		fprintf(f, "Queued Messages             %d\n",  window_);
+	} else if ( window_ > 1 ) {
+		fprintf(f, "Target Reply Buffers        %d\n",  nBufs_);
+		fprintf(f, "Pipeline Window             %d\n",  window_);
+		fprintf(f, "Retransmitted Messages      %ld\n", nRetrans_);
+	}
+	if ( rle_ ) {
+		fprintf(f, "Compressed Shifts (tx/rx)   %ld/%ld\n", nRleTx_, nRleRx_);
+	}
+	if ( clk_ ) {
+		fprintf(f, "Clock Commands              %ld\n", nClkCmds_);
+	}
+	if ( probeMs_ ) {
+		fprintf(f, "Health Probe Period    (ms) %d\n",  probeMs_);
+		fprintf(f, "Target Resets Detected      %ld\n", tgtResets_);
+	}
 }
 
 void
@@ -516,18 +1625,36 @@ SockSd::getSd()
 	return sd_;
 }
 
+bool
+SockSd::setBusyPoll(unsigned us)
+{
+int val = us;
+
+	if ( ::setsockopt( sd_, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val) ) ) {
+		fprintf(stderr, "WARNING: unable to set SO_BUSY_POLL (%s)\n", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
 XvcServer::XvcServer(
 	uint16_t    port,
 	JtagDriver *drv,
 	unsigned    debug,
 	unsigned    maxMsgSize,
-	bool        once
+	bool        once,
+	unsigned    connFlags
 )
 : sock_      ( true       ),
   drv_       ( drv        ),
   debug_     ( debug      ),
   maxMsgSize_( maxMsgSize ),
-  once_      ( once       )
+  once_      ( once       ),
+  connFlags_ ( connFlags  ),
+  port_      ( port       ),
+  nConns_    ( 0          ),
+  nShifts_   ( 0          ),
+  nBits_     ( 0          )
 {
 struct sockaddr_in a;
 int               yes = 1;
@@ -549,39 +1676,175 @@ int               yes = 1;
 		throw SysErr("Unable to listen on socket");
 	}
 
+	// XvcConn drains pending connections from its event loop
+	if ( ::fcntl( sock_.getSd(), F_SETFL, ::fcntl( sock_.getSd(), F_GETFL ) | O_NONBLOCK ) ) {
+		throw SysErr("Unable to make listening socket non-blocking");
+	}
+
+}
+
+void
+XvcServer::setBusyPoll(unsigned us)
+{
+	// inherited by the accepted connection
+	sock_.setBusyPoll( us );
 }
 
 void
 XvcServer::run()
 {
 	do {
-	XvcConn conn( sock_.getSd(), drv_, maxMsgSize_ );
+	std::unique_ptr<XvcConn> conn( XvcConn::create( sock_.getSd(), drv_, maxMsgSize_, connFlags_ ) );
+		// an error ends this session only
 		try {
-			conn.run();
-		} catch (SysErr &e) {
+			conn->run();
+		} catch ( std::runtime_error &e ) {
 			fprintf(stderr,"Closing connection (%s)\n", e.what());
 		}
+		nConns_++;
+		nShifts_ += conn->getShifts();
+		nBits_   += conn->getBits();
+		conn.reset();
+		drv_->connDone();
+		if ( debug_ > 0 ) {
+			dumpStats();
+		}
 	} while ( ! once_ );
 }
 
+void
+XvcServer::dumpStats(FILE *f)
+{
+	fprintf(f, "Port %d: %lu connections, %lu shifts, %lu bits\n", port_, nConns_, nShifts_, nBits_);
+}
+
 static void
 usage(const char *nm)
 {
 DriverRegistry *registry = DriverRegistry::get();
 
-	fprintf(stderr,"Usage: %s [-v{v}] [-Vh] [-D <driver>] [-p <port>] -t <target> [ -- <driver_options>]\n", nm);
+	fprintf(stderr,"Usage: %s [-v{v}] [-VhSCUHL] [-D <driver>] [-p <port>] -t <target> [ -- <driver_options>]\n", nm);
 	fprintf(stderr,"  -t <target> : contact target (depends on driver; e.g., <ip[:port]>)\n");
+	fprintf(stderr,"                may be repeated; every target is served on its own\n");
+	fprintf(stderr,"                port by its own driver instance and thread. -D, -p\n");
+	fprintf(stderr,"                and -A apply to the -t they precede (and all following\n");
+	fprintf(stderr,"                ones); the port is incremented unless given again.\n");
 	fprintf(stderr,"  -h          : this message\n");
 	fprintf(stderr,"  -D <driver> : use transport driver 'driver'\n");
 	fprintf(stderr,"                   built-in drivers:\n");
 	registry->printRegisteredDrivers(stderr, "                   '%s'\n");
 	fprintf(stderr,"                   'udpLoopback'\n");
+	JtagDriverLayer::usage();
 	fprintf(stderr,"                the default driver is: '%s'\n", DEFAULTDRVNAME);
 	fprintf(stderr,"  -p <port>   : bind to TCP port <port> (default: 2542)\n");
 	fprintf(stderr,"  -M          : max XVC vector size (default 32768)\n");
 	fprintf(stderr,"  -v          : verbose (more 'v's increase verbosity)\n");
 	fprintf(stderr,"  -V          : print version information\n");
 	fprintf(stderr,"  -T <mode>   : set test mode/flags\n");
+	fprintf(stderr,"  -H          : back connection buffers by huge pages\n");
+	fprintf(stderr,"  -P <ms>     : probe target health every <ms> while idle (default: off)\n");
+	fprintf(stderr,"  -R <prio>   : run with SCHED_FIFO priority <prio>\n");
+	fprintf(stderr,"  -A <cpu>[,<cpu>]\n");
+	fprintf(stderr,"              : pin the server (and the 'udpLoopback' FW emulation\n");
+	fprintf(stderr,"                thread) to <cpu>\n");
+	fprintf(stderr,"  -L          : lock all memory (mlockall)\n");
+	fprintf(stderr,"  -B <us>     : busy-poll TCP (and 'udpLoopback' FW emulation) socket\n");
+	fprintf(stderr,"                for <us> microseconds (SO_BUSY_POLL)\n");
+	fprintf(stderr,"  -S          : streaming shift; pass chunks to the driver while\n");
+	fprintf(stderr,"                the rest of the TDI vector is still arriving\n");
+	fprintf(stderr,"  -C          : cut-through; send TDO of every chunk to the client\n");
+	fprintf(stderr,"                as soon as the driver has it\n");
+#ifdef HAVE_LIBURING
+	fprintf(stderr,"  -U          : use io_uring for the TCP connection\n");
+#else
+	fprintf(stderr,"  -U          : use io_uring for the TCP connection (NOT SUPPORTED\n");
+	fprintf(stderr,"                by this build; liburing was not found)\n");
+#endif
+}
+
+// latency tuning; failures are not fatal
+
+static void
+setRtPrio(unsigned prio)
+{
+struct sched_param p;
+int                st;
+
+	p.sched_priority = prio;
+	if ( (st = pthread_setschedparam( pthread_self(), SCHED_FIFO, &p )) ) {
+		fprintf(stderr, "WARNING: unable to set SCHED_FIFO priority %d (%s)\n", prio, strerror(st));
+	}
+}
+
+static void
+pinThread(pthread_t t, int cpu, const char *what)
+{
+cpu_set_t set;
+int       st;
+
+	CPU_ZERO( &set );
+	CPU_SET( cpu, &set );
+	if ( (st = pthread_setaffinity_np( t, sizeof(set), &set )) ) {
+		fprintf(stderr, "WARNING: unable to pin %s to CPU %d (%s)\n", what, cpu, strerror(st));
+	}
+}
+
+// A target served by its own driver, TCP port and thread
+typedef struct XvcTarget {
+	const char  *drvnam;
+	const char  *target;
+	unsigned     port;
+	int          srvCpu;
+	int          loopCpu;
+	JtagDriver  *drv;
+	bool         setTest;
+	unsigned     testMode;
+	unsigned     probeMs;
+	unsigned     nTgts;
+	UdpLoopBack *loop;
+	pthread_t    loopT;
+	XvcServer   *srv;
+	pthread_t    srvT;
+} XvcTarget;
+
+static void *
+serverThread(void *arg)
+{
+XvcTarget *t = (XvcTarget*) arg;
+
+	if ( t->srvCpu >= 0 ) {
+		pinThread( pthread_self(), t->srvCpu, "server" );
+	}
+
+	// initialize fully constructed object; a target that is not
+	// (yet) reachable doesn't keep the others from being served
+	while ( 1 ) {
+		try {
+			t->drv->init();
+			break;
+		} catch ( std::runtime_error &e ) {
+			fprintf(stderr,"ERROR: Target '%s': initialization failed (%s); retrying in %ds\n",
+			        t->target ? t->target : "", e.what(), INIT_RETRY_S);
+			sleep( INIT_RETRY_S );
+		}
+	}
+
+	if ( t->setTest ) {
+		t->drv->setTestMode( t->testMode );
+	}
+
+	t->drv->setHealthProbe( t->probeMs );
+
+	if ( t->drv->getDebug() > 0 ) {
+		if ( t->nTgts > 1 ) {
+			printf("Target '%s' on port %d:\n", t->target ? t->target : "", t->port);
+		}
+		t->drv->dumpInfo();
+	}
+
+	t->srv->run();
+
+	return 0;
 }
 
 static void *
@@ -702,18 +1965,31 @@ const char     *target   = 0;
 const char     *drvnam   = DEFAULTDRVNAME;
 unsigned        port     = 2542;
 unsigned       *i_p      = 0;
-JtagDriver     *drv      = 0;
 void           *hdl;
-UdpLoopBack    *loop     = 0;
-pthread_t       loopT;
 unsigned        maxMsg   = 32768;
 DriverRegistry *registry = DriverRegistry::init();
 bool            setTest  = false;
 unsigned        testMode = 0;
 bool            once     = false;
 bool            help     = false;
-
-	while ( (opt = getopt(argc, argv, "hvVost:D:p:M:T:")) > 0 ) {
+unsigned        flags    = 0;
+unsigned        probeMs  = 0;
+unsigned        rtPrio   = 0;
+int             srvCpu   = -1;
+int             loopCpu  = -1;
+bool            lockMem  = false;
+unsigned        busyPoll = 0;
+vector<XvcTarget> tgts;
+XvcTarget       tgt;
+XvcTarget      *t;
+unsigned        i;
+int             drvOptInd;
+int             cpu;
+char            lbTarget[32];
+std::string     drvBase;
+const char     *layers;
+
+	while ( (opt = getopt(argc, argv, "hvVoSCUHLst:D:p:M:T:P:R:A:B:")) > 0 ) {
         i_p = 0;
 		switch ( opt ) {
 			default:
@@ -734,6 +2010,17 @@ bool            help     = false;
 
 			case 't':
 				target = optarg;
+				// -D, -p, -A preceding a -t apply to this (and subsequent)
+				// targets; the port is incremented if not changed.
+				if ( tgts.size() > 0 && port == tgts.back().port ) {
+					port++;
+				}
+				tgt.target = target;
+				tgt.drvnam = drvnam;
+				tgt.port   = port;
+				tgt.srvCpu = srvCpu;
+				tgt.loopCpu= loopCpu;
+				tgts.push_back( tgt );
 				break;
 
 			case 's':
@@ -757,9 +2044,52 @@ bool            help     = false;
 				setTest = true;
 				break;
 
+			case 'P':
+				i_p = &probeMs;
+				break;
+
+			case 'R':
+				i_p = &rtPrio;
+				break;
+
+			case 'A':
+				loopCpu = -1;
+				if ( sscanf( optarg, "%i,%i", &srvCpu, &loopCpu ) < 1 ) {
+					fprintf(stderr,"Unable to scan arg for option '-%c': %s\n", opt, optarg);
+					return 1;
+				}
+				break;
+
+			case 'L':
+				lockMem = true;
+				break;
+
+			case 'B':
+				i_p = &busyPoll;
+				break;
+
 			case 'o':
 				once = true;
 				break;
+
+			case 'H':
+				XvcBufPool::get()->setHugePages( true );
+				break;
+
+			case 'S':
+				flags |= XvcConn::STREAM_SHIFT;
+				break;
+
+			case 'C':
+				flags |= XvcConn::CUT_THROUGH;
+				break;
+
+			case 'U':
+#ifndef HAVE_LIBURING
+				fprintf(stderr,"WARNING: built without liburing; -U ignored\n");
+#endif
+				flags |= XvcConn::IO_URING;
+				break;
 		}
 		if ( i_p && 1 != sscanf(optarg, "%i", i_p) ) {
 			fprintf(stderr,"Unable to scan arg for option '-%c': %s\n", opt, optarg);
@@ -767,73 +2097,139 @@ bool            help     = false;
 		}
 	}
 
+	// with a single target the order of options doesn't matter
+	if ( tgts.size() < 2 ) {
+		tgts.clear();
+		tgt.target = target;
+		tgt.drvnam = drvnam;
+		tgt.port   = port;
+		tgt.srvCpu = srvCpu;
+		tgt.loopCpu= loopCpu;
+		tgts.push_back( tgt );
+	}
+
     // Reset opterr so that drivers can parse options after '--'
 	opterr = 0;
+	drvOptInd = optind;
+
+	for ( i = 0; i < tgts.size(); i++ ) {
+		t       = &tgts[i];
+		t->drv  = 0;
+		t->loop = 0;
+		// '<driver>+<layer>...'
+		drvBase = t->drvnam;
+		layers  = strchr( t->drvnam, '+' );
+		if ( layers ) {
+			drvBase.erase( layers - t->drvnam );
+			layers++;
+		}
+		drvnam  = drvBase.c_str();
 
-	try {
-		if ( 0 == strcmp( drvnam, "udpLoopback" ) ) {
+		// every driver instance parses the same driver options
+		optind  = drvOptInd;
+
+		try {
+			if ( 0 == strcmp( drvnam, "udpLoopback" ) ) {
+				if ( help ) {
+					JtagDriverUdp::usage();
+					return 0;
+				}
+				// each instance gets its own FW emulation port
+				snprintf( lbTarget, sizeof(lbTarget), "localhost:%d", 2543 + i );
+				t->drv  = new JtagDriverUdp( argc, argv, lbTarget );
+				t->loop = new UdpLoopBack( t->target, 2543 + i );
+			} else {
+				if ( ! registry->has( drvnam ) ) {	
+					if ( ! (hdl = dlopen( drvnam, RTLD_NOW | RTLD_GLOBAL )) ) {
+						throw std::runtime_error(std::string("Unable to load requested driver: ") + std::string(dlerror()));
+					}
+					drvnam = 0;
+				}
+			}
 			if ( help ) {
-				JtagDriverUdp::usage();
+				registry->usage( drvnam );
 				return 0;
 			}
-			drv  = new JtagDriverUdp( argc, argv, "localhost:2543" );
-			loop = new UdpLoopBack( target, 2543 );
-		} else {
-			if ( ! registry->has( drvnam ) ) {	
-				if ( ! (hdl = dlopen( drvnam, RTLD_NOW | RTLD_GLOBAL )) ) {
-					throw std::runtime_error(std::string("Unable to load requested driver: ") + std::string(dlerror()));
-				}
-				drvnam = 0;
+
+			if ( ! t->drv ) {
+				t->drv = registry->create( drvnam, argc, argv, t->target );
 			}
-		}
-		if ( help ) {
+
+			if ( t->drv && layers ) {
+				t->drv = JtagDriverLayer::stack( t->drv, layers );
+			}
+
+		} catch ( std::runtime_error &e ) {
+			fprintf(stderr, "%s\n\n", e.what());
+			usage(argv[0]);
 			registry->usage( drvnam );
-			return 0;
+			return 1;
 		}
 
-		if ( ! drv ) {
-			drv = registry->create( drvnam, argc, argv, target );
+		if ( ! t->drv ) {
+			fprintf(stderr,"ERROR: No transport-driver found\n");
+			return 1;
 		}
-
-	} catch ( std::runtime_error &e ) {
-		fprintf(stderr, "%s\n\n", e.what());
-		usage(argv[0]);
-		registry->usage( drvnam );
-		return 1;
 	}
 
+	// latency profile; threads created below inherit the
+	// scheduling policy
+	if ( lockMem && mlockall( MCL_CURRENT | MCL_FUTURE ) ) {
+		fprintf(stderr, "WARNING: mlockall failed (%s)\n", strerror(errno));
+	}
 
-	if ( ! drv ) {
-		fprintf(stderr,"ERROR: No transport-driver found\n");
-		return 1;
+	if ( rtPrio ) {
+		setRtPrio( rtPrio );
 	}
 
-	// must fire up the loopback UDP (FW emulation) first
-	if ( loop ) {
+	for ( i = 0; i < tgts.size(); i++ ) {
+		t = &tgts[i];
+
+		// must fire up the loopback UDP (FW emulation) first
+		if ( t->loop ) {
+
+			t->loop->setDebug( debug );
+			t->loop->init();
 
-		loop->setDebug( debug );
-		loop->init();
+			if ( busyPoll ) {
+				t->loop->setBusyPoll( busyPoll );
+			}
+
+			if ( pthread_create( &t->loopT, 0, udpTestThread, t->loop ) ) {
+				throw SysErr("Unable to launch UDP loopback test thread");
+			}
 
-		if ( pthread_create( &loopT, 0, udpTestThread, loop ) ) {
-			throw SysErr("Unable to launch UDP loopback test thread");
+			// share the server's CPU unless told otherwise
+			if ( (cpu = t->loopCpu >= 0 ? t->loopCpu : t->srvCpu) >= 0 ) {
+				pinThread( t->loopT, cpu, "UDP loopback thread" );
+			}
 		}
-	}
 
 
-	drv->setDebug( debug );
-	// initialize fully constructed object
-	drv->init();
+		t->drv->setDebug( debug );
+		// the server thread initializes the driver
+		t->setTest  = setTest;
+		t->testMode = testMode;
+		t->probeMs  = probeMs;
+		t->nTgts    = tgts.size();
 
+		t->srv = new XvcServer( t->port, t->drv, debug, maxMsg, once, flags );
 
-	if ( setTest ) {
-		drv->setTestMode( testMode );
+		if ( busyPoll ) {
+			t->srv->setBusyPoll( busyPoll );
+		}
 	}
 
-	if ( drv->getDebug() > 0 ) {
-		drv->dumpInfo();
+	// the first target is served by 'main' itself
+	for ( i = 1; i < tgts.size(); i++ ) {
+		if ( pthread_create( &tgts[i].srvT, 0, serverThread, &tgts[i] ) ) {
+			throw SysErr("Unable to launch server thread");
+		}
 	}
 
-XvcServer s(port, drv, debug, maxMsg, once);
+	serverThread( &tgts[0] );
 
-	s.run();
+	for ( i = 1; i < tgts.size(); i++ ) {
+		pthread_join( tgts[i].srvT, 0 );
+	}
 }
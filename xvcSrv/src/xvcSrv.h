@@ -27,6 +27,12 @@ private:
 	unsigned          debug_;
 	unsigned          maxMsgSize_;
 	bool              once_;
+	unsigned          connFlags_;
+	uint16_t          port_;
+	// statistics (accumulated over all connections)
+	unsigned long     nConns_;
+	unsigned long     nShifts_;
+	unsigned long     nBits_;
 
 public:
 	XvcServer(
@@ -34,11 +40,17 @@ public:
 		JtagDriver *drv,
 		unsigned debug=0,
 		unsigned maxMsgSize = 32768,
-		bool once = false
+		bool once = false,
+		unsigned connFlags = 0
 	);
 
+	// busy-poll the TCP connection for 'us' microseconds
+	virtual void setBusyPoll(unsigned us);
+
 	virtual void run();
 
+	virtual void dumpStats(FILE *f = stderr);
+
 	virtual ~XvcServer()
 	{
 	};
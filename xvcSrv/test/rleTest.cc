@@ -0,0 +1,191 @@
+//-----------------------------------------------------------------------------
+// Title      : JTAG Support
+//-----------------------------------------------------------------------------
+// Company    : SLAC National Accelerator Laboratory
+//-----------------------------------------------------------------------------
+// Description: Round-trip test of the run-length codec (xvcRle). See
+//              'makefile' for how this is normally invoked.
+//-----------------------------------------------------------------------------
+// This file is part of 'SLAC Firmware Standard Library'.
+// It is subject to the license terms in the LICENSE.txt file found in the
+// top-level directory of this distribution and at:
+//    https://confluence.slac.stanford.edu/display/ppareg/LICENSE.html.
+// No part of 'SLAC Firmware Standard Library', including this file,
+// may be copied, modified, propagated, or distributed except according to
+// the terms contained in the LICENSE.txt file.
+//-----------------------------------------------------------------------------
+
+#include <xvcRle.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using std::vector;
+
+static int nFailed = 0;
+
+static void
+fail(const char *what, unsigned long n, long got, long exp)
+{
+	fprintf(stderr, "FAILED: %s (n = %lu): got %ld, expected %ld\n", what, n, got, exp);
+	nFailed++;
+}
+
+// encode 'n' octets of 'src', check the encoded length (unless 'expLen'
+// is negative) and that decoding reproduces 'src'
+static void
+roundTrip(const char *what, const uint8_t *src, unsigned long n, long expLen)
+{
+vector<uint8_t> enc( 2*n + 16 );
+vector<uint8_t> dec( n + 1 );
+unsigned long   len;
+long            used;
+
+	len = rleEncode( &enc[0], enc.size(), src, n );
+	if ( expLen >= 0 && (long)len != expLen ) {
+		fail( what, n, len, expLen );
+		return;
+	}
+	if ( 0 == len ) {
+		fail( what, n, len, 1 );
+		return;
+	}
+	dec[n] = 0xa5;
+	if ( (used = rleDecode( &dec[0], n, &enc[0], len )) != (long)len ) {
+		fail( what, n, used, len );
+		return;
+	}
+	if ( memcmp( &dec[0], src, n ) ) {
+		fail( what, n, 0, 1 );
+	}
+	if ( 0xa5 != dec[n] ) {
+		fail( "decoder overran its buffer", n, dec[n], 0xa5 );
+	}
+}
+
+static void
+literal(unsigned long n, long expLen)
+{
+vector<uint8_t> v( n );
+unsigned long   i;
+
+	// no two neighbours alike
+	for ( i = 0; i < n; i++ ) {
+		v[i] = i;
+	}
+	roundTrip( "literal", &v[0], n, expLen );
+}
+
+static void
+run(unsigned long n, long expLen)
+{
+vector<uint8_t> v( n, 0xff );
+
+	roundTrip( "run", &v[0], n, expLen );
+}
+
+int
+main()
+{
+vector<uint8_t> v( 3*RLE_MAX_RUN );
+vector<uint8_t> enc( 2*v.size() );
+unsigned long   i, n, len;
+
+	// nothing to encode; 0 is also what an overflow returns
+	if ( 0 != (len = rleEncode( &enc[0], enc.size(), &v[0], 0 )) ) {
+		fail( "empty vector", 0, len, 0 );
+	}
+	if ( 0 != rleDecode( &v[0], 0, &enc[0], 0 ) ) {
+		fail( "decode empty vector", 0, 1, 0 );
+	}
+
+	// literals hold up to 128 octets
+	literal(   1,   2 );
+	literal( 127, 128 );
+	literal( 128, 129 );
+	literal( 129, 131 );
+	literal( 256, 258 );
+	literal( 257, 260 );
+
+	// shorter runs are cheaper as part of a literal
+	run(   3,   4 );
+	run(   4,   3 );
+	// runs hold up to RLE_MAX_RUN octets
+	run( RLE_MAX_RUN - 1, 3 );
+	run( RLE_MAX_RUN    , 3 );
+	// remainder of 1 is a literal
+	run( RLE_MAX_RUN + 1, 5 );
+	run( RLE_MAX_RUN + 4, 6 );
+	run( 2*RLE_MAX_RUN  , 6 );
+
+	// literal - run - literal
+	for ( i = 0; i < 200; i++ ) {
+		v[i] = i;
+	}
+	memset( &v[200], 0x55, 1000 );
+	for ( i = 1200; i < 1300; i++ ) {
+		v[i] = i;
+	}
+	roundTrip( "literal-run-literal", &v[0], 1300, (1 + 128) + (1 + 72) + 3 + (1 + 100) );
+
+	// random mix of runs and literals
+	srand( 1 );
+	for ( n = 0; n < 1000; n++ ) {
+		unsigned long sz = 1 + rand() % v.size();
+		for ( i = 0; i < sz; ) {
+			unsigned long l = 1 + ( rand() & 1 ? rand() % 300 : rand() % (RLE_MAX_RUN + 300) );
+			uint8_t       d = rand();
+			if ( l > sz - i ) {
+				l = sz - i;
+			}
+			if ( rand() & 1 ) {
+				memset( &v[i], d, l );
+				i += l;
+			} else {
+				while ( l-- > 0 ) {
+					v[i++] = rand();
+				}
+			}
+		}
+		roundTrip( "random", &v[0], sz, -1 );
+	}
+
+	// overflow: one octet short of the encoded length
+	for ( i = 0; i < 1300; i++ ) {
+		v[i] = i;
+	}
+	memset( &v[200], 0x55, 1000 );
+	n   = rleEncode( &enc[0], enc.size(), &v[0], 1300 );
+	if ( 0 != (len = rleEncode( &enc[0], n - 1, &v[0], 1300 )) ) {
+		fail( "overflow (literal)", 1300, len, 0 );
+	}
+	if ( n != (len = rleEncode( &enc[0], n, &v[0], 1300 )) ) {
+		fail( "exact fit", 1300, len, n );
+	}
+	memset( &v[0], 0, 100 );
+	if ( 0 != (len = rleEncode( &enc[0], 2, &v[0], 100 )) ) {
+		fail( "overflow (run)", 100, len, 0 );
+	}
+
+	// malformed input
+	n = rleEncode( &enc[0], enc.size(), &v[0], 1300 );
+	if ( -1 != rleDecode( &v[0], 1300, &enc[0], n - 1 ) ) {
+		fail( "truncated input", 1300, 0, -1 );
+	}
+	enc[0] = 0x80; enc[1] = 0x10; enc[2] = 0x00;
+	if ( -1 != rleDecode( &v[0], 16, &enc[0], 3 ) ) {
+		fail( "run longer than the vector", 16, 0, -1 );
+	}
+	enc[0] = 0x10;
+	if ( -1 != rleDecode( &v[0], 16, &enc[0], 18 ) ) {
+		fail( "literal longer than the vector", 16, 0, -1 );
+	}
+
+	if ( nFailed ) {
+		fprintf(stderr, "RLE Test FAILED (%d errors)\n", nFailed);
+		return 1;
+	}
+	printf("RLE Test PASSED\n");
+	return 0;
+}
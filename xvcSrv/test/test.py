@@ -16,6 +16,7 @@ import io
 import sys
 import os
 import array
+import random
 import getopt
 from socket import *;
 
@@ -122,14 +123,103 @@ def playfile(f):
         m = None
 
 
+def recvall(sd, byts):
+  got = bytearray()
+  while len(got) < byts:
+    tmp = sd.recv(byts - len(got))
+    if len(tmp) == 0:
+      raise RuntimeError("Connection closed")
+    got.extend(tmp)
+  return got
+
+def shift(sd, tms, tdi):
+  vec=bytearray()
+  ser(vec, [8*len(tms)], 4)
+  vec.extend(tms)
+  vec.extend(tdi)
+  sd.send(bytearray('shift:','ascii'))
+  sd.send(vec)
+  return recvall(sd, len(tms))
+
+# Idle runs: the server must only clock runs in Run-Test/Idle by command
+# (if enabled with '-k'; their TDO is reported as zeros). Needs a target
+# which loops TDI back (udpLoopback w/o a TDO file).
+def idletest(clocked):
+  run  = 4096
+  # Test-Logic-Reset, Run-Test/Idle
+  tms  = bytearray([0x1f])
+  tdi  = bytearray([0x00])
+  idl1 = len(tms)
+  tms.extend( bytearray(run) )
+  tdi.extend( bytearray([0xff]*run) )
+  # Select-DR, Capture-DR, Shift-DR; not idle although TMS is zero
+  tms.extend( bytearray([0x01]) )
+  tdi.extend( bytearray([0xff]) )
+  shft = len(tms)
+  tms.extend( bytearray(run) )
+  tdi.extend( bytearray([0xff]*run) )
+  # Exit1-DR, Update-DR, Run-Test/Idle
+  tms.extend( bytearray([0x03]) )
+  tdi.extend( bytearray([0xff]) )
+  idl2 = len(tms)
+  tms.extend( bytearray(run) )
+  tdi.extend( bytearray([0xff]*run) )
+  with socket(AF_INET,SOCK_STREAM) as sd:
+    sd.connect(("localhost",2542))
+    got = shift(sd, tms, tdi)
+    if got[shft:shft+run] != tdi[shft:shft+run]:
+      raise RuntimeError("TDO MISMATCH (Shift-DR)")
+    for (beg, what) in [(idl1, "first run"), (idl2, "second run")]:
+      zeros = got[beg:beg+run].count(0)
+      print("Idle {}: {} of {} octets clocked".format(what, zeros, run))
+      # the run is split at word boundaries
+      if ( clocked and zeros < run - 32 ) or ( not clocked and zeros != 0 ):
+        raise RuntimeError("IDLE RUN MISMATCH ({})".format(what))
+    # still idle from the last vector
+    got = shift(sd, bytearray(run), bytearray([0xff]*run))
+    zeros = got.count(0)
+    print("Idle continued: {} of {} octets clocked".format(zeros, run))
+    if ( clocked and zeros < run - 32 ) or ( not clocked and zeros != 0 ):
+      raise RuntimeError("IDLE RUN MISMATCH (continued)")
+  print("Idle runs -- Test PASSED")
+
+# Long random vectors (segmented messages with a small datagram size;
+# the emulation drops every 256th datagram so frames must be resent).
+# Needs a target which loops TDI back (udpLoopback w/o a TDO file).
+def looptest(nvecs):
+  rng = random.Random(1)
+  with socket(AF_INET,SOCK_STREAM) as sd:
+    sd.connect(("localhost",2542))
+    for i in range(0, nvecs):
+      byts = rng.randint(1, 32768)
+      tms  = bytearray( rng.getrandbits(8) for j in range(0, byts) )
+      tdi  = bytearray( rng.getrandbits(8) for j in range(0, byts) )
+      if shift(sd, tms, tdi) != tdi:
+        raise RuntimeError("TDO MISMATCH (vector {}, {} octets)".format(i, byts))
+  print("{} random vectors -- Test PASSED".format(nvecs))
+
 if __name__ == "__main__":
-  (opts, args) = getopt.getopt(sys.argv[1:], "k")
-  dokill = False
+  (opts, args) = getopt.getopt(sys.argv[1:], "kicl:")
+  dokill  = False
+  idle    = False
+  clocked = False
+  nvecs   = 0
   for (o, a) in opts:
     if o == '-k':
       dokill = True;
+    if o == '-i':
+      idle = True;
+    if o == '-c':
+      clocked = True;
+    if o == '-l':
+      nvecs = int(a);
   try:
-    playfile('testData.txt')
+    if idle:
+      idletest(clocked)
+    elif nvecs > 0:
+      looptest(nvecs)
+    else:
+      playfile('testData.txt')
   except:
     if dokill:
       os.kill( os.getpgid(0), 15 )